@@ -22,6 +22,7 @@
 #include <cassert>
 
 #include "BoostedClassifier.hpp"
+#include "CompiledModel.hpp"
 #include "utils.hpp"
 
 #include <chrono>
@@ -78,9 +79,7 @@ BoostedClassifier::BoostedClassifier(const Parameters &params,
                  (int)negSamples.size(), (int)samplePositions.size());
     }
 
-    samplePositions.insert(samplePositions.end(),
-                           negSamples.begin(),
-                           negSamples.end());
+    samplePositions.append(negSamples);
 
     /* Classifier's cumulated response */
     EVec currentResponse(samplePositions.size());
@@ -89,7 +88,7 @@ BoostedClassifier::BoostedClassifier(const Parameters &params,
     /* Labels corresponding to the sampled set */
     EVec Y(samplePositions.size());
     for (unsigned int i = 0; i < samplePositions.size(); ++i) {
-        Y(i) = samplePositions[i].label;
+        Y(i) = samplePositions.label(i);
     }
     /* At the beginning, all the samples are equal... */
     EVec W(samplePositions.size());
@@ -98,7 +97,7 @@ BoostedClassifier::BoostedClassifier(const Parameters &params,
     /* ... but some samples are more equal than the others: those in images
        returned by a technician will have their weight increased */
     for (unsigned int i = 0; i < samplePositions.size(); ++i) {
-        if (dataset.isFeedbackImage(samplePositions[i].imageNo)) {
+        if (dataset.isFeedbackImage(samplePositions.imageNo(i))) {
             W(i) = FEEDBACK_SAMPLE_WEIGHT;
         }
     }
@@ -175,6 +174,8 @@ BoostedClassifier::BoostedClassifier(const Parameters &params,
              elapsed_s.count());
 #endif // TESTS
 
+    compile();
+
     /* Store the individual classifier in a file */
     std::string BC_json;
     JSONSerializer::Serialize(this, BC_json);
@@ -224,6 +225,7 @@ BoostedClassifier::BoostedClassifier(const BoostedClassifier &obj)
         weakLearners[i] = new WeakLearner(*(obj.weakLearners[i]));
     }
     gtPair = obj.gtPair;
+    compile();
 }
 
 BoostedClassifier &
@@ -244,6 +246,7 @@ BoostedClassifier::operator=(const BoostedClassifier &rhs)
                 new WeakLearner(*(rhs.weakLearners[i]));
         }
         gtPair = rhs.gtPair;
+        compile();
     }
 
     return *this;
@@ -290,53 +293,56 @@ BoostedClassifier::classify(const Dataset &dataset,
 void
 BoostedClassifier::classifyImage(const Dataset &DS,
                                  const int imageNo,
-                                 const sampleSet& ePoints,
+                                 const runSet& ePoints,
                                  EMat &prediction) const
 {
-    EMat tmp = DS.getData(0, imageNo);
+    const ChannelPlane &tmp = DS.getData(0, imageNo);
 
     prediction.resize(tmp.rows(),
                       tmp.cols());
     prediction.setZero();
 
-    if (ePoints.size() == 0) {
-        return;
-    }
-
-    EVec partialResults(ePoints.size());
-    partialResults.setZero();
+    /* Expand the runs one block of points at a time, so that only a
+       bounded set of sample positions is alive at any moment */
+    sampleSet block;
+    block.reserve(CANDIDATES_BLOCK_SIZE);
+    EVec partialResults;
+    for (unsigned int i = 0; i < ePoints.size(); ++i) {
+        const pointRun &run = ePoints[i];
+        for (unsigned int c = 0; c < run.length; ++c) {
+            block.push_back(samplePos(imageNo, run.row, run.col+c, 0));
+        }
+        if (block.size() < CANDIDATES_BLOCK_SIZE && i+1 < ePoints.size()) {
+            continue;
+        }
 
-    for (unsigned int w = 0; w < weakLearners.size(); ++w) {
-        EVec currentResponse;
         /* Call the same function used in training */
-        weakLearners[w]->evaluate(DS,
-                                  ePoints,
-                                  currentResponse);
-        partialResults += currentResponse;
-    }
-
-    for (unsigned int i = 0; i < ePoints.size(); ++i) {
-        prediction(ePoints[i].row,
-                   ePoints[i].col) = partialResults(i);
+        classify(DS, block, partialResults);
+        for (unsigned int j = 0; j < block.size(); ++j) {
+            prediction(block.row(j), block.col(j)) = partialResults(j);
+        }
+        block.clear();
     }
 }
 
 void
-BoostedClassifier::classifyFullImage(const std::vector< cv::Mat > &imgVec,
+BoostedClassifier::classifyFullImage(const std::vector< ImageBuffer > &imgVec,
                                      const unsigned int borderSize,
-                                     EMat &prediction) const
+                                     EMat &prediction,
+                                     const EByteMat *mask) const
 {
-    prediction.resize(imgVec[0].rows-2*borderSize,
-                      imgVec[0].cols-2*borderSize);
-    prediction.setZero();
+    std::vector< EMat > predictions;
+    compiledModel->classifyFullImage(imgVec, borderSize, predictions, mask);
+    prediction.swap(predictions[0]);
+}
 
-    for (unsigned int w = 0; w < weakLearners.size(); ++w) {
-        EMat currentResponse;
-        weakLearners[w]->evaluateOnImage(imgVec,
-                                         borderSize,
-                                         currentResponse);
-        prediction += currentResponse;
-    }
+void
+BoostedClassifier::compile()
+{
+    /* Filters shared by several weak learners are applied once */
+    compiledModel.reset(new CompiledModel(
+                            std::vector< const BoostedClassifier * >(1,
+                                                                     this)));
 }
 
 void
@@ -347,6 +353,18 @@ BoostedClassifier::getChCount(std::vector< int > &count)
     }
 }
 
+const std::vector< WeakLearner * > &
+BoostedClassifier::getWeakLearners() const
+{
+    return weakLearners;
+}
+
+const CompiledModel &
+BoostedClassifier::getCompiledModel() const
+{
+    return *compiledModel;
+}
+
 void
 BoostedClassifier::Serialize(Json::Value &root)
 {
@@ -377,4 +395,5 @@ BoostedClassifier::Deserialize(Json::Value &root)
         weakLearners.push_back(wl);
     }
     gtPair = root["BoostedClassifier"]["params"]["gtPair"].asInt();
+    compile();
 }
@@ -24,6 +24,7 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <memory>
 
 #include "DataTypes.hpp"
 #include "logging.hpp"
@@ -32,12 +33,19 @@
 #include "JSONSerializable.hpp"
 #include "WeakLearner.hpp"
 
+class CompiledModel;
+
+/* Number of candidate points classified at once by classifyImage() */
+const unsigned int CANDIDATES_BLOCK_SIZE = 16384;
+
 /**
  * class BoostedClassifier - Boosted Classifier main class, grouping all weak
  *                           learners
  *
- * @weakLearners: weak learners
- * @gtPair      : ground truth pair considered by the classifier
+ * @weakLearners : weak learners
+ * @gtPair       : ground truth pair considered by the classifier
+ * @compiledModel: weak learners compiled for full-image classification,
+ *                 built once the weak learners are known
  */
 class BoostedClassifier : public JSONSerializable {
 public:
@@ -137,13 +145,13 @@ public:
      *
      * @DS        : dataset where the points have to be extracted
      * @imageNo   : number of the image to classify
-     * @ePoints   : set of candidate points
+     * @ePoints   : runs of candidate points
      *
      * @prediction: computed result image
      */
     void classifyImage(const Dataset &DS,
                        const int imageNo,
-                       const sampleSet& ePoints,
+                       const runSet& ePoints,
                        EMat &prediction) const;
 
     /**
@@ -155,10 +163,14 @@ public:
      *              result
      *
      * @prediction: computed result image
+     *
+     * @mask      : optional mask of the pixels to classify, the other ones
+     *              being left to 0 (an empty mask includes all the pixels)
      */
-    void classifyFullImage(const std::vector< cv::Mat > &imgVec,
+    void classifyFullImage(const std::vector< ImageBuffer > &imgVec,
                            const unsigned int borderSize,
-                           EMat &prediction) const;
+                           EMat &prediction,
+                           const EByteMat *mask = nullptr) const;
 
     /**
      * getChCount() - Get the fraction of filters for each specific channel
@@ -167,6 +179,21 @@ public:
      */
     void getChCount(std::vector< int > &count);
 
+    /**
+     * getWeakLearners() - Get the weak learners of the classifier
+     *
+     * Return: weak learners, in boosting order
+     */
+    const std::vector< WeakLearner * > &getWeakLearners() const;
+
+    /**
+     * getCompiledModel() - Get the weak learners of the classifier compiled
+     *                      for full-image classification
+     *
+     * Return: compiled model of the classifier
+     */
+    const CompiledModel &getCompiledModel() const;
+
     /**
      * Serialize() - Serialize a boosted classifier in JSON format
      *
@@ -177,6 +204,12 @@ public:
 private:
     std::vector< WeakLearner * > weakLearners;
     unsigned int gtPair;
+    std::unique_ptr< const CompiledModel > compiledModel;
+
+    /**
+     * compile() - Compile the weak learners for full-image classification
+     */
+    void compile();
 
     /**
      * Deserialize() - Deserialize a boosted classifier in JSON format
@@ -0,0 +1,382 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <functional>
+#include <thread>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "ChannelCache.hpp"
+#include "logging.hpp"
+
+/* Magic string at the beginning of each cache entry */
+static const char CACHE_MAGIC[8] = { 'M', 'V', 'B', 'L', 'C', 'H', 'S', 0 };
+/* Alignment of the sections in a cache entry */
+static const uint64_t CACHE_ALIGNMENT = 64;
+/* FNV-1a prime */
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+/**
+ * struct cacheHeader - Header of a cache entry file
+ *
+ * @magic        : CACHE_MAGIC
+ * @version      : CHANNEL_CACHE_VERSION
+ * @sectionsNo   : number of sections following the header
+ * @key          : key of the entry
+ * @rows         : rows of the stored planes
+ * @cols         : columns of the stored planes
+ * @originalRows : rows of the input image before resizing
+ * @originalCols : columns of the input image before resizing
+ * @chNo         : number of channel sections
+ * @gtsNo        : number of gt sections
+ * @hasOriginalGt: whether an original gt section is present
+ * @ePointsNo    : number of runs of candidate points
+ *
+ * The header is followed by the section descriptors, in this order:
+ * channels, mask, gts, original gt (if any), candidate points.
+ */
+typedef struct cacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionsNo;
+    uint64_t key;
+    uint32_t rows;
+    uint32_t cols;
+    int32_t originalRows;
+    int32_t originalCols;
+    uint32_t chNo;
+    uint32_t gtsNo;
+    uint32_t hasOriginalGt;
+    uint32_t ePointsNo;
+} cacheHeader;
+
+/**
+ * struct cacheSection - Descriptor of a section of a cache entry
+ *
+ * @storage : storage format of the values (planeStorage)
+ * @scale   : scale of the codes (uint8 storage only)
+ * @offset  : offset of the codes (uint8 storage only)
+ * @reserved: padding
+ * @start   : offset of the section from the beginning of the file
+ * @size    : size of the section, in bytes
+ */
+typedef struct cacheSection {
+    uint32_t storage;
+    float scale;
+    float offset;
+    uint32_t reserved;
+    uint64_t start;
+    uint64_t size;
+} cacheSection;
+
+ChannelCache::ChannelCache(const std::string &cacheDir)
+    : cacheDir(cacheDir)
+{
+    if (cacheDir.empty()) {
+        return;
+    }
+    if (access(cacheDir.c_str(), F_OK) != 0) {
+        log_info("\tCreating channel cache directory %s",
+                 cacheDir.c_str());
+        if (mkdir(cacheDir.c_str(), 0700) < 0 && errno != EEXIST) {
+            perror("mkdir");
+            throw std::runtime_error("cacheDirCreation");
+        }
+    }
+}
+
+void
+ChannelCache::hashBytes(const void *data, const size_t size,
+                        uint64_t &hash)
+{
+    const unsigned char *bytes = static_cast< const unsigned char * >(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+}
+
+int
+ChannelCache::hashFile(const std::string &path, uint64_t &hash)
+{
+    std::ifstream file(path, std::ifstream::binary);
+    if (!file.is_open()) {
+        log_err("Unable to open %s", path.c_str());
+        return -EXIT_FAILURE;
+    }
+
+    std::vector< char > chunk(1 << 16);
+    while (file) {
+        file.read(chunk.data(), chunk.size());
+        hashBytes(chunk.data(), file.gcount(), hash);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+bool
+ChannelCache::load(const uint64_t key, cacheEntry &entry,
+                   const bool channelsOnly) const
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    const std::string path = getEntryPath(key);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0 ||
+        (size_t)status.st_size < sizeof(cacheHeader)) {
+        close(fd);
+        return false;
+    }
+    const size_t fileSize = status.st_size;
+    void *addr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    /* The mapping lives as long as one of the planes pointing into it */
+    std::shared_ptr< unsigned char >
+        mapping(static_cast< unsigned char * >(addr),
+                [fileSize](unsigned char *p) { munmap(p, fileSize); });
+
+    const cacheHeader *header =
+        reinterpret_cast< const cacheHeader * >(mapping.get());
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header->version != CHANNEL_CACHE_VERSION ||
+        header->key != key ||
+        header->sectionsNo != header->chNo+header->gtsNo+
+                              header->hasOriginalGt+2 ||
+        sizeof(cacheHeader)+header->sectionsNo*sizeof(cacheSection) >
+        fileSize) {
+        log_err("Invalid cache entry %s, ignoring it", path.c_str());
+        return false;
+    }
+
+    const cacheSection *sections =
+        reinterpret_cast< const cacheSection * >(header+1);
+    const size_t planeSize = (size_t)header->rows*header->cols;
+    for (unsigned int i = 0; i < header->sectionsNo; ++i) {
+        const cacheSection &s = sections[i];
+        bool valid = s.start+s.size <= fileSize &&
+            s.start%CACHE_ALIGNMENT == 0;
+        if (i == header->sectionsNo-1) {
+            /* Candidate points: row, col and length of each run */
+            valid = valid && s.size == header->ePointsNo*3*sizeof(int32_t);
+        } else {
+            valid = valid && s.storage <= PLANE_UINT8 &&
+                s.size ==
+                planeSize*ChannelPlane::getValueSize((planeStorage)s.storage);
+        }
+        if (!valid) {
+            log_err("Corrupted cache entry %s, ignoring it", path.c_str());
+            return false;
+        }
+    }
+
+    const unsigned int rows = header->rows;
+    const unsigned int cols = header->cols;
+    unsigned int sNo = 0;
+    entry.channels.clear();
+    for (unsigned int i = 0; i < header->chNo; ++i, ++sNo) {
+        const cacheSection &s = sections[sNo];
+        entry.channels.push_back(
+            ChannelPlane(rows, cols, (planeStorage)s.storage,
+                         s.scale, s.offset,
+                         std::shared_ptr< unsigned char >(mapping,
+                                                          mapping.get()+
+                                                          s.start)));
+    }
+    if (channelsOnly) {
+        return true;
+    }
+
+    /* Masks and gts are small and modified later on, copy them */
+    typedef Eigen::Map< const EByteMat > constByteMap;
+    typedef Eigen::Map< const ELabelMat > constLabelMap;
+    entry.mask = constByteMap(mapping.get()+sections[sNo++].start,
+                              rows, cols);
+    entry.gts.clear();
+    for (unsigned int i = 0; i < header->gtsNo; ++i, ++sNo) {
+        const signed char *labels =
+            reinterpret_cast< const signed char * >(mapping.get()+
+                                                    sections[sNo].start);
+        entry.gts.push_back(constLabelMap(labels, rows, cols));
+    }
+    if (header->hasOriginalGt) {
+        entry.originalGt = constByteMap(mapping.get()+sections[sNo++].start,
+                                        rows, cols);
+    } else {
+        entry.originalGt.resize(0, 0);
+    }
+
+    const int32_t *points =
+        reinterpret_cast< const int32_t * >(mapping.get()+
+                                            sections[sNo].start);
+    entry.ePoints.resize(header->ePointsNo);
+    for (unsigned int i = 0; i < header->ePointsNo; ++i) {
+        entry.ePoints[i].row = points[3*i];
+        entry.ePoints[i].col = points[3*i+1];
+        entry.ePoints[i].length = points[3*i+2];
+    }
+    entry.originalSize = std::make_pair(header->originalRows,
+                                        header->originalCols);
+
+    return true;
+}
+
+int
+ChannelCache::store(const uint64_t key, const cacheEntry &entry) const
+{
+    if (!isEnabled()) {
+        return EXIT_SUCCESS;
+    }
+
+    const unsigned int rows = entry.mask.rows();
+    const unsigned int cols = entry.mask.cols();
+
+    cacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CHANNEL_CACHE_VERSION;
+    header.key = key;
+    header.rows = rows;
+    header.cols = cols;
+    header.originalRows = entry.originalSize.first;
+    header.originalCols = entry.originalSize.second;
+    header.chNo = entry.channels.size();
+    header.gtsNo = entry.gts.size();
+    header.hasOriginalGt = entry.originalGt.size() > 0;
+    header.ePointsNo = entry.ePoints.size();
+    header.sectionsNo = header.chNo+header.gtsNo+header.hasOriginalGt+2;
+
+    /* Lay out the sections and collect their content */
+    std::vector< cacheSection > sections(header.sectionsNo);
+    std::vector< const void * > contents(header.sectionsNo);
+    std::vector< int32_t > points(3*entry.ePoints.size());
+    for (unsigned int i = 0; i < entry.ePoints.size(); ++i) {
+        points[3*i] = entry.ePoints[i].row;
+        points[3*i+1] = entry.ePoints[i].col;
+        points[3*i+2] = entry.ePoints[i].length;
+    }
+    unsigned int sNo = 0;
+    for (unsigned int i = 0; i < entry.channels.size(); ++i, ++sNo) {
+        const ChannelPlane &ch = entry.channels[i];
+        if (ch.rows() != rows || ch.cols() != cols) {
+            log_err("Inconsistent channel size, not caching the entry");
+            return -EXIT_FAILURE;
+        }
+        sections[sNo].storage = ch.getStorage();
+        sections[sNo].scale = ch.getScale();
+        sections[sNo].offset = ch.getOffset();
+        sections[sNo].size = ch.getByteSize();
+        contents[sNo] = ch.getValues();
+    }
+    /* Masks and gts are stored as raw bytes (gt labels are signed) */
+    std::vector< std::pair< const void *, Eigen::Index > > planes;
+    planes.push_back(std::make_pair(entry.mask.data(), entry.mask.size()));
+    for (unsigned int i = 0; i < entry.gts.size(); ++i) {
+        if (entry.gts[i].rows() != rows || entry.gts[i].cols() != cols) {
+            log_err("Inconsistent mask/gt size, not caching the entry");
+            return -EXIT_FAILURE;
+        }
+        planes.push_back(std::make_pair(entry.gts[i].data(),
+                                        entry.gts[i].size()));
+    }
+    if (header.hasOriginalGt) {
+        if (entry.originalGt.rows() != rows ||
+            entry.originalGt.cols() != cols) {
+            log_err("Inconsistent mask/gt size, not caching the entry");
+            return -EXIT_FAILURE;
+        }
+        planes.push_back(std::make_pair(entry.originalGt.data(),
+                                        entry.originalGt.size()));
+    }
+    for (unsigned int i = 0; i < planes.size(); ++i, ++sNo) {
+        sections[sNo].storage = PLANE_UINT8;
+        sections[sNo].size = planes[i].second;
+        contents[sNo] = planes[i].first;
+    }
+    sections[sNo].size = points.size()*sizeof(int32_t);
+    contents[sNo] = points.data();
+
+    uint64_t start = sizeof(cacheHeader)+
+        header.sectionsNo*sizeof(cacheSection);
+    for (unsigned int i = 0; i < header.sectionsNo; ++i) {
+        start = (start+CACHE_ALIGNMENT-1)/CACHE_ALIGNMENT*CACHE_ALIGNMENT;
+        sections[i].start = start;
+        start += sections[i].size;
+    }
+
+    /* Write to a private temporary file, then publish it atomically */
+    const std::string path = getEntryPath(key);
+    const std::string tmpPath = path+".tmp."+std::to_string(getpid())+
+        "."+std::to_string(std::hash< std::thread::id >()(
+                               std::this_thread::get_id()));
+    std::ofstream file(tmpPath, std::ofstream::binary);
+    if (!file.is_open()) {
+        log_err("Unable to create cache entry %s", tmpPath.c_str());
+        return -EXIT_FAILURE;
+    }
+    file.write(reinterpret_cast< const char * >(&header), sizeof(header));
+    file.write(reinterpret_cast< const char * >(sections.data()),
+               sections.size()*sizeof(cacheSection));
+    const char padding[CACHE_ALIGNMENT] = { 0 };
+    uint64_t written = sizeof(cacheHeader)+
+        header.sectionsNo*sizeof(cacheSection);
+    for (unsigned int i = 0; i < header.sectionsNo; ++i) {
+        file.write(padding, sections[i].start-written);
+        file.write(static_cast< const char * >(contents[i]),
+                   sections[i].size);
+        written = sections[i].start+sections[i].size;
+    }
+    file.close();
+
+    if (!file || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        log_err("Unable to write cache entry %s", path.c_str());
+        unlink(tmpPath.c_str());
+        return -EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+std::string
+ChannelCache::getEntryPath(const uint64_t key) const
+{
+    std::ostringstream name;
+    name << cacheDir << "/" << std::hex << std::setw(16)
+         << std::setfill('0') << key << ".chs";
+    return name.str();
+}
@@ -0,0 +1,147 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef CHANNELCACHE_HPP_
+#define CHANNELCACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "ChannelPlane.hpp"
+#include "DataTypes.hpp"
+
+/* Version of the on-disk format of the cache entries, bump it whenever the
+   format or the way channels are computed changes */
+const uint32_t CHANNEL_CACHE_VERSION = 3;
+
+/* Initial value of the FNV-1a hashes used as cache keys */
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+
+/**
+ * struct cacheEntry - Data computed from a single input image
+ *
+ * @channels    : computed channels
+ * @mask        : image mask
+ * @gts         : ground-truths, one per gt pair (empty when testing)
+ * @originalGt  : original ground-truth (empty when testing)
+ * @ePoints     : runs of candidate points for fast classification
+ * @originalSize: size of the input image before resizing (rows, cols)
+ */
+typedef struct cacheEntry {
+    std::vector< ChannelPlane > channels;
+    EByteMat mask;
+    std::vector< ELabelMat > gts;
+    EByteMat originalGt;
+    runSet ePoints;
+    std::pair< int, int > originalSize;
+} cacheEntry;
+
+/**
+ * class ChannelCache - On-disk cache of the data computed from the input
+ *                      images
+ *
+ * @cacheDir: directory holding the cache entries (empty if disabled)
+ *
+ * Each entry is a single binary file named after its key. Channel values are
+ * stored with their storage format and aligned, so that loaded entries are
+ * memory-mapped and used in place: the pages of an entry are shared by all
+ * the processes using it. Entries are written to a temporary file and then
+ * renamed, so concurrent runs never see partial entries.
+ */
+class ChannelCache {
+public:
+    /**
+     * ChannelCache() - Create a disabled cache
+     */
+    ChannelCache() { };
+
+    /**
+     * ChannelCache() - Create a cache stored in the given directory
+     *
+     * @cacheDir: cache directory (created if needed), an empty path
+     *            disables the cache
+     */
+    ChannelCache(const std::string &cacheDir);
+
+    /**
+     * isEnabled() - Check if the cache is in use
+     *
+     * Return: true if the cache is enabled, false otherwise
+     */
+    bool isEnabled() const { return !cacheDir.empty(); }
+
+    /**
+     * hashBytes() - Update a FNV-1a hash with a set of bytes
+     *
+     * @data: bytes to hash
+     * @size: number of bytes to hash
+     * @hash: hash to update
+     */
+    static void hashBytes(const void *data, const size_t size,
+                          uint64_t &hash);
+
+    /**
+     * hashFile() - Update a FNV-1a hash with the content of a file
+     *
+     * @path: path of the file to hash
+     * @hash: hash to update
+     *
+     * Return: -EXIT_FAILURE if the file cannot be read, EXIT_SUCCESS
+     *         otherwise
+     */
+    static int hashFile(const std::string &path, uint64_t &hash);
+
+    /**
+     * load() - Load an entry from the cache
+     *
+     * @key         : key of the entry
+     * @entry       : loaded entry (channels point into the mapped file)
+     * @channelsOnly: load the channels only, leaving the other fields of
+     *                the entry untouched
+     *
+     * Return: true if a valid entry was found, false otherwise
+     */
+    bool load(const uint64_t key, cacheEntry &entry,
+              const bool channelsOnly = false) const;
+
+    /**
+     * store() - Store an entry in the cache
+     *
+     * @key  : key of the entry
+     * @entry: entry to store
+     *
+     * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
+     */
+    int store(const uint64_t key, const cacheEntry &entry) const;
+
+private:
+    std::string cacheDir;
+
+    /**
+     * getEntryPath() - Get the path of the file holding an entry
+     *
+     * @key: key of the entry
+     *
+     * Return: path of the entry
+     */
+    std::string getEntryPath(const uint64_t key) const;
+};
+
+#endif /* CHANNELCACHE_HPP_ */
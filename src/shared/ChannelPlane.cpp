@@ -0,0 +1,125 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <algorithm>
+
+#include "ChannelPlane.hpp"
+
+ChannelPlane::ChannelPlane()
+    : nRows(0), nCols(0), storage(PLANE_FLOAT32), scale(1), offset(0),
+      byteSize(0)
+{
+}
+
+ChannelPlane::ChannelPlane(const unsigned int rows,
+                           const unsigned int cols,
+                           const planeStorage storage)
+    : nRows(rows), nCols(cols), storage(storage), scale(1), offset(0)
+{
+    assert(storage == PLANE_FLOAT32 || storage == PLANE_FLOAT16);
+
+    byteSize = (size_t)nRows*nCols*getValueSize(storage);
+    memory.reset(new unsigned char[byteSize],
+                 std::default_delete< unsigned char[] >());
+}
+
+ChannelPlane::ChannelPlane(const EMat &src, const planeStorage storage)
+    : ChannelPlane(src.rows(), src.cols(), storage)
+{
+    for (unsigned int r = 0; r < nRows; ++r) {
+        setRow(r, src.row(r).data());
+    }
+}
+
+ChannelPlane::ChannelPlane(const cv::Mat &codes,
+                           const float scale,
+                           const float offset)
+    : nRows(codes.rows), nCols(codes.cols), storage(PLANE_UINT8),
+      scale(scale), offset(offset)
+{
+    assert(codes.type() == CV_8UC1);
+
+    byteSize = (size_t)nRows*nCols;
+    memory.reset(new unsigned char[byteSize],
+                 std::default_delete< unsigned char[] >());
+    for (unsigned int r = 0; r < nRows; ++r) {
+        const unsigned char *src = codes.ptr< unsigned char >(r);
+        std::copy(src, src+nCols, memory.get()+(size_t)r*nCols);
+    }
+}
+
+ChannelPlane::ChannelPlane(const unsigned int rows,
+                           const unsigned int cols,
+                           const planeStorage storage,
+                           const float scale,
+                           const float offset,
+                           const std::shared_ptr< unsigned char > &memory)
+    : nRows(rows), nCols(cols), storage(storage), scale(scale),
+      offset(offset), memory(memory)
+{
+    byteSize = (size_t)nRows*nCols*getValueSize(storage);
+}
+
+size_t
+ChannelPlane::getValueSize(const planeStorage storage)
+{
+    switch (storage) {
+    case PLANE_UINT8:
+        return sizeof(unsigned char);
+    case PLANE_FLOAT16:
+        return sizeof(Eigen::half);
+    default:
+        return sizeof(float);
+    }
+}
+
+void
+ChannelPlane::setRow(const unsigned int r, const float *src)
+{
+    assert(r < nRows);
+
+    const size_t idx = (size_t)r*nCols;
+    switch (storage) {
+    case PLANE_FLOAT16: {
+        Eigen::half *dst =
+            reinterpret_cast< Eigen::half * >(memory.get())+idx;
+        for (unsigned int c = 0; c < nCols; ++c) {
+            dst[c] = Eigen::half(src[c]);
+        }
+        break;
+    }
+    case PLANE_FLOAT32:
+        std::copy(src, src+nCols,
+                  reinterpret_cast< float * >(memory.get())+idx);
+        break;
+    default:
+        /* Codes planes are only built from 8-bit images */
+        assert(false);
+        break;
+    }
+}
+
+void
+ChannelPlane::toEMat(EMat &dst) const
+{
+    dst.resize(nRows, nCols);
+    for (unsigned int r = 0; r < nRows; ++r) {
+        getRowSegment(r, 0, nCols, dst.row(r).data());
+    }
+}
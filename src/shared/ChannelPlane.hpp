@@ -0,0 +1,300 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef CHANNELPLANE_HPP_
+#define CHANNELPLANE_HPP_
+
+#include <vector>
+#include <memory>
+#include <cassert>
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include <Eigen/Core>
+#include <opencv2/opencv.hpp>
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+#include "DataTypes.hpp"
+#include "simd.hpp"
+
+/* Storage formats available for the planes of a data channel */
+enum planeStorage {
+    PLANE_FLOAT32 = 0,
+    PLANE_FLOAT16,
+    PLANE_UINT8
+};
+
+/**
+ * class ChannelPlane - One image plane of a data channel, kept in a compact
+ *                      storage format and expanded to float when read
+ *
+ * @nRows  : number of rows of the plane
+ * @nCols  : number of columns of the plane
+ * @storage: format of the stored values
+ * @scale  : scale applied to the stored codes (uint8 storage only)
+ * @offset : offset added to the scaled codes (uint8 storage only)
+ * @memory : stored values, row-major (either owned by the plane or pointing
+ *           into a memory-mapped cache entry)
+ * @byteSize: size of the stored values, in bytes
+ *
+ * Float32 planes hold the values as they are, float16 planes hold them
+ * rounded to half precision, and uint8 planes hold integer codes whose value
+ * is code*scale+offset. The latter is exact for the channels that are
+ * intrinsically 8-bit (colour planes, CLAHE output, LBP codes).
+ *
+ * Planes are not modified once built, hence copies share the stored values.
+ */
+class ChannelPlane {
+public:
+    /**
+     * ChannelPlane() - Create an empty plane
+     */
+    ChannelPlane();
+
+    /**
+     * ChannelPlane() - Create an uninitialized plane of the given size, to be
+     *                  filled with setRow()
+     *
+     * @rows   : number of rows of the plane
+     * @cols   : number of columns of the plane
+     * @storage: storage format (either PLANE_FLOAT32 or PLANE_FLOAT16)
+     */
+    ChannelPlane(const unsigned int rows,
+                 const unsigned int cols,
+                 const planeStorage storage);
+
+    /**
+     * ChannelPlane() - Create a plane holding the content of a matrix
+     *
+     * @src    : source values
+     * @storage: storage format (either PLANE_FLOAT32 or PLANE_FLOAT16)
+     */
+    explicit ChannelPlane(const EMat &src,
+                          const planeStorage storage = PLANE_FLOAT32);
+
+    /**
+     * ChannelPlane() - Create a uint8 plane from a set of 8-bit codes
+     *
+     * @codes : source codes (CV_8UC1)
+     * @scale : scale applied to the codes when they are read
+     * @offset: offset added to the scaled codes when they are read
+     */
+    ChannelPlane(const cv::Mat &codes,
+                 const float scale,
+                 const float offset);
+
+    /**
+     * ChannelPlane() - Create a plane over values stored elsewhere
+     *
+     * @rows   : number of rows of the plane
+     * @cols   : number of columns of the plane
+     * @storage: storage format of the values
+     * @scale  : scale applied to the codes (uint8 storage only)
+     * @offset : offset added to the scaled codes (uint8 storage only)
+     * @memory : stored values (kept alive as long as the plane exists)
+     */
+    ChannelPlane(const unsigned int rows,
+                 const unsigned int cols,
+                 const planeStorage storage,
+                 const float scale,
+                 const float offset,
+                 const std::shared_ptr< unsigned char > &memory);
+
+    /**
+     * rows() - Get the number of rows of the plane
+     *
+     * Return: number of rows
+     */
+    unsigned int rows() const { return nRows; }
+
+    /**
+     * cols() - Get the number of columns of the plane
+     *
+     * Return: number of columns
+     */
+    unsigned int cols() const { return nCols; }
+
+    /**
+     * getStorage() - Get the storage format of the plane
+     *
+     * Return: storage format
+     */
+    planeStorage getStorage() const { return storage; }
+
+    /**
+     * getByteSize() - Get the amount of memory used by the stored values
+     *
+     * Return: size of the stored values, in bytes
+     */
+    size_t getByteSize() const { return byteSize; }
+
+    /**
+     * getScale() - Get the scale applied to the stored codes
+     *
+     * Return: scale of the codes
+     */
+    float getScale() const { return scale; }
+
+    /**
+     * getOffset() - Get the offset added to the scaled codes
+     *
+     * Return: offset of the codes
+     */
+    float getOffset() const { return offset; }
+
+    /**
+     * getValues() - Get the raw stored values
+     *
+     * Return: pointer to the first stored value
+     */
+    const unsigned char *getValues() const { return memory.get(); }
+
+    /**
+     * getValueSize() - Get the size of a single value for a storage format
+     *
+     * @storage: considered storage format
+     *
+     * Return: size of a value, in bytes
+     */
+    static size_t getValueSize(const planeStorage storage);
+
+    /**
+     * at() - Read a single value of the plane
+     *
+     * @r: row of the value
+     * @c: column of the value
+     *
+     * Return: value expanded to float
+     */
+    inline float at(const unsigned int r, const unsigned int c) const
+    {
+        assert(r < nRows && c < nCols);
+
+        const size_t idx = (size_t)r*nCols+c;
+        switch (storage) {
+        case PLANE_UINT8:
+            return memory.get()[idx]*scale+offset;
+        case PLANE_FLOAT16:
+            return (float)halfData()[idx];
+        default:
+            return floatData()[idx];
+        }
+    }
+
+    /**
+     * getRowSegment() - Expand a contiguous segment of a row to float
+     *
+     * @r  : row of the segment
+     * @c  : first column of the segment
+     * @n  : number of values in the segment
+     * @dst: destination buffer (at least n values)
+     */
+    inline void getRowSegment(const unsigned int r,
+                              const unsigned int c,
+                              const unsigned int n,
+                              float *dst) const
+    {
+        assert(r < nRows && c+n <= nCols);
+
+        const size_t idx = (size_t)r*nCols+c;
+        switch (storage) {
+        case PLANE_UINT8:
+            expandU8(memory.get()+idx, n, scale, offset, dst);
+            break;
+        case PLANE_FLOAT16:
+            expandF16(halfData()+idx, n, dst);
+            break;
+        default:
+            std::copy(floatData()+idx, floatData()+idx+n, dst);
+            break;
+        }
+    }
+
+    /**
+     * dotRowSegment() - Compute the dot product of a contiguous segment of a
+     *                   row with a set of weights, without expanding it
+     *
+     * @r   : row of the segment
+     * @c   : first column of the segment
+     * @n   : number of values in the segment
+     * @w   : weights (n values)
+     * @sumW: sum of the weights (used to apply the offset of uint8 planes)
+     *
+     * Return: dot product of the expanded values with the weights
+     */
+    inline float dotRowSegment(const unsigned int r,
+                               const unsigned int c,
+                               const unsigned int n,
+                               const float *w,
+                               const float sumW) const
+    {
+        assert(r < nRows && c+n <= nCols);
+
+        const size_t idx = (size_t)r*nCols+c;
+        switch (storage) {
+        case PLANE_UINT8:
+            /* sum((code*scale+offset)*w) = scale*sum(code*w)+offset*sum(w) */
+            return dotU8(memory.get()+idx, w, n)*scale+offset*sumW;
+        case PLANE_FLOAT16:
+            return dotF16(halfData()+idx, w, n);
+        default:
+            return dotF32(floatData()+idx, w, n);
+        }
+    }
+
+    /**
+     * setRow() - Store a whole row of a plane created with its size only
+     *
+     * @r  : row to store
+     * @src: row values (nCols values)
+     */
+    void setRow(const unsigned int r, const float *src);
+
+    /**
+     * toEMat() - Expand the whole plane to float
+     *
+     * @dst: resulting matrix
+     */
+    void toEMat(EMat &dst) const;
+
+private:
+    unsigned int nRows;
+    unsigned int nCols;
+    planeStorage storage;
+    float scale;
+    float offset;
+    std::shared_ptr< unsigned char > memory;
+    size_t byteSize;
+
+    const float *floatData() const
+    {
+        return reinterpret_cast< const float * >(memory.get());
+    }
+
+    const Eigen::half *halfData() const
+    {
+        return reinterpret_cast< const Eigen::half * >(memory.get());
+    }
+};
+
+typedef std::vector< ChannelPlane > dataVector;
+typedef std::vector< dataVector > dataChannels;
+
+#endif /* CHANNELPLANE_HPP_ */
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <map>
+#include <string>
+
+#include "CompiledModel.hpp"
+#include "FilterBank.hpp"
+#include "scheduler.hpp"
+
+/* Memory taken at once by the response planes of a band of rows, for each
+   image being classified */
+static std::atomic< size_t > bandBytes(256 << 20);
+
+/* Pixels classified at once by a worker: the features they read from the
+   response planes stay in cache while the trees are walked */
+static const unsigned int TILE_PIXELS = 4096;
+
+/**
+ * appendMat() - Append the values of a matrix to a key
+ *
+ * @m  : matrix (CV_32FC1)
+ * @key: key to extend
+ */
+static void
+appendMat(const cv::Mat &m, std::string &key)
+{
+    const int dims[2] = { m.rows, m.cols };
+    key.append(reinterpret_cast< const char * >(dims), sizeof(dims));
+    for (int r = 0; r < m.rows; ++r) {
+        key.append(reinterpret_cast< const char * >(m.ptr< float >(r)),
+                   m.cols*sizeof(float));
+    }
+}
+
+CompiledModel::CompiledModel(const std::vector< const BoostedClassifier * >
+                             &classifiers)
+    : classifiersNo(classifiers.size())
+{
+    /* Distinct filters are told apart by their channel and their weights,
+       separable terms included */
+    std::map< std::string, unsigned int > kernelIdxs;
+    for (unsigned int c = 0; c < classifiers.size(); ++c) {
+        const std::vector< WeakLearner * > &weakLearners =
+            classifiers[c]->getWeakLearners();
+        for (unsigned int w = 0; w < weakLearners.size(); ++w) {
+            learnerUses uses;
+            uses.learner = weakLearners[w];
+            uses.classifier = c;
+
+            const FilterBank &fb = weakLearners[w]->getFilterBank();
+            for (unsigned int f = 0; f < fb.getFiltersNo(); ++f) {
+                unsigned int chNo;
+                convKernel kernel;
+                fb.getKernel(f, chNo, kernel);
+                std::string key(reinterpret_cast< const char * >(&chNo),
+                                sizeof(chNo));
+                appendMat(kernel.weights, key);
+                appendMat(kernel.colFactors, key);
+                appendMat(kernel.rowFactors, key);
+
+                auto it = kernelIdxs.find(key);
+                if (it == kernelIdxs.end()) {
+                    it = kernelIdxs.insert(std::make_pair(key,
+                                                          kernels.size()))
+                        .first;
+                    uniqueKernel unique;
+                    unique.chNo = chNo;
+                    unique.kernel = kernel;
+                    unique.rowSpread = 0;
+                    unique.colSpread = 0;
+                    kernels.push_back(unique);
+                }
+
+                /* Widen the plane of the filter to cover this position
+                   too (the offsets are fixed once all are known) */
+                uniqueKernel &unique = kernels[it->second];
+                const unsigned int lastRow =
+                    std::max(unique.kernel.row+unique.rowSpread, kernel.row);
+                const unsigned int lastCol =
+                    std::max(unique.kernel.col+unique.colSpread, kernel.col);
+                unique.kernel.row = std::min(unique.kernel.row, kernel.row);
+                unique.kernel.col = std::min(unique.kernel.col, kernel.col);
+                unique.rowSpread = lastRow-unique.kernel.row;
+                unique.colSpread = lastCol-unique.kernel.col;
+                const kernelUse use = { it->second, kernel.row, kernel.col };
+                uses.features.push_back(use);
+            }
+            learners.push_back(uses);
+        }
+    }
+
+    for (unsigned int l = 0; l < learners.size(); ++l) {
+        for (unsigned int f = 0; f < learners[l].features.size(); ++f) {
+            kernelUse &use = learners[l].features[f];
+            use.row -= kernels[use.kernel].kernel.row;
+            use.col -= kernels[use.kernel].kernel.col;
+        }
+    }
+}
+
+void
+CompiledModel::classifyFullImage(const std::vector< ImageBuffer > &imgVec,
+                                 const unsigned int borderSize,
+                                 std::vector< EMat > &predictions,
+                                 const EByteMat *mask) const
+{
+    assert (!imgVec.empty());
+
+    const unsigned int nRows = imgVec[0].rows()-2*borderSize;
+    const unsigned int nCols = imgVec[0].cols()-2*borderSize;
+    predictions.assign(classifiersNo, EMat(EMat::Zero(nRows, nCols)));
+
+    const bool masked = mask != nullptr && mask->size() > 0;
+    assert(!masked || (mask->rows() == nRows && mask->cols() == nCols));
+
+    /* Columns spanned by the pixels to classify on each row, empty on the
+       rows that are masked out */
+    std::vector< unsigned int > firstCols(nRows, 0);
+    std::vector< unsigned int > endCols(nRows, nCols);
+    if (masked) {
+        for (unsigned int y = 0; y < nRows; ++y) {
+            firstCols[y] = nCols;
+            endCols[y] = 0;
+            for (unsigned int x = 0; x < nCols; ++x) {
+                if ((*mask)(y, x) == MASK_INCLUDED) {
+                    firstCols[y] = std::min(firstCols[y], x);
+                    endCols[y] = x+1;
+                }
+            }
+        }
+    }
+
+    /* A model without filters still walks its trees */
+    size_t rowBytes = 1;
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        rowBytes += (nCols+kernels[k].colSpread)*sizeof(float);
+    }
+    const unsigned int bandRows =
+        std::min((size_t)nRows, std::max(bandBytes/rowBytes, (size_t)1));
+
+    std::vector< EMat > planes(kernels.size());
+    std::vector< std::vector< featureRef > > refs(learners.size());
+    for (unsigned int y0 = 0; y0 < nRows; ) {
+        /* Bands are made of consecutive rows holding pixels to classify,
+           and cover only the columns these pixels span */
+        if (firstCols[y0] >= endCols[y0]) {
+            ++y0;
+            continue;
+        }
+        unsigned int rows = 0;
+        unsigned int x0 = nCols;
+        unsigned int x1 = 0;
+        while (rows < bandRows && y0+rows < nRows &&
+               firstCols[y0+rows] < endCols[y0+rows]) {
+            x0 = std::min(x0, firstCols[y0+rows]);
+            x1 = std::max(x1, endCols[y0+rows]);
+            ++rows;
+        }
+        const unsigned int cols = x1-x0;
+        computePlanes(imgVec, borderSize, y0, x0, rows, cols, planes);
+
+        for (unsigned int l = 0; l < learners.size(); ++l) {
+            const std::vector< kernelUse > &features = learners[l].features;
+            refs[l].resize(features.size());
+            for (unsigned int f = 0; f < features.size(); ++f) {
+                const EMat &plane = planes[features[f].kernel];
+                refs[l][f].base = plane.data()+
+                    (size_t)features[f].row*plane.cols()+features[f].col;
+                refs[l][f].stride = plane.cols();
+            }
+        }
+
+        /* Each tile walks the trees of all the weak learners, in boosting
+           order, and accumulates their responses in place. Tiles and
+           pixels that are masked out are skipped */
+        const unsigned int tileCols = std::min(cols, TILE_PIXELS);
+        const unsigned int tileRows = std::max(TILE_PIXELS/tileCols, 1U);
+        const unsigned int colTilesNo = (cols+tileCols-1)/tileCols;
+        const unsigned int rowTilesNo = (rows+tileRows-1)/tileRows;
+        parallelFor(rowTilesNo*colTilesNo, [&](unsigned int t) {
+            const unsigned int ty = (t/colTilesNo)*tileRows;
+            const unsigned int tx = (t%colTilesNo)*tileCols;
+            const unsigned int yEnd = std::min(ty+tileRows, rows);
+            const unsigned int xEnd = std::min(tx+tileCols, cols);
+            const auto included = [&](unsigned int y, unsigned int x) {
+                return !masked || (*mask)(y0+y, x0+x) == MASK_INCLUDED;
+            };
+            bool any = false;
+            for (unsigned int y = ty; y < yEnd && !any; ++y) {
+                for (unsigned int x = tx; x < xEnd && !any; ++x) {
+                    any = included(y, x);
+                }
+            }
+            if (!any) {
+                return;
+            }
+
+            for (unsigned int l = 0; l < learners.size(); ++l) {
+                const WeakLearner &learner = *learners[l].learner;
+                const std::vector< featureRef > &ref = refs[l];
+                float *dst = predictions[learners[l].classifier].data()+
+                    (size_t)y0*nCols+x0;
+                for (unsigned int y = ty; y < yEnd; ++y) {
+                    for (unsigned int x = tx; x < xEnd; ++x) {
+                        if (!included(y, x)) {
+                            continue;
+                        }
+                        dst[(size_t)y*nCols+x] +=
+                            learner.predictSample([&](unsigned int f) {
+                                return ref[f].base[(size_t)y*ref[f].stride+
+                                                   x];
+                            });
+                    }
+                }
+            }
+        });
+
+        y0 += rows;
+    }
+}
+
+void
+CompiledModel::computePlanes(const std::vector< ImageBuffer > &imgVec,
+                             const unsigned int borderSize,
+                             const unsigned int firstRow,
+                             const unsigned int firstCol,
+                             const unsigned int rows,
+                             const unsigned int cols,
+                             std::vector< EMat > &planes) const
+{
+    std::vector< convJob > jobs(kernels.size());
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        assert(kernels[k].chNo < imgVec.size());
+        planes[k].resize(rows+kernels[k].rowSpread,
+                         cols+kernels[k].colSpread);
+
+        /* The filters read the channel starting one pixel before the
+           position of their top-left corner in the sample */
+        jobs[k].chNo = kernels[k].chNo;
+        jobs[k].rows = planes[k].rows();
+        jobs[k].cols = planes[k].cols();
+        jobs[k].kernel = kernels[k].kernel;
+        jobs[k].kernel.row += borderSize-1+firstRow;
+        jobs[k].kernel.col += borderSize-1+firstCol;
+        jobs[k].kernel.dst = planes[k].data();
+    }
+    correlateJobs(imgVec, jobs);
+}
+
+void
+CompiledModel::setBandBytes(const size_t bytes)
+{
+    bandBytes = bytes;
+}
+
+unsigned int
+CompiledModel::getKernelsNo() const
+{
+    return kernels.size();
+}
+
+unsigned int
+CompiledModel::getFeaturesNo() const
+{
+    unsigned int featuresNo = 0;
+    for (unsigned int l = 0; l < learners.size(); ++l) {
+        featuresNo += learners[l].features.size();
+    }
+    return featuresNo;
+}
@@ -0,0 +1,192 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef COMPILED_MODEL_HPP_
+#define COMPILED_MODEL_HPP_
+
+#include <vector>
+
+#include "BoostedClassifier.hpp"
+#include "convolution.hpp"
+#include "DataTypes.hpp"
+#include "ImageBuffer.hpp"
+#include "WeakLearner.hpp"
+
+/**
+ * class CompiledModel - Set of boosted classifiers evaluated together on the
+ *                       same channels, each distinct filter being applied
+ *                       once per image
+ *
+ * @kernels      : distinct filters of the classifiers
+ * @learners     : weak learners of the classifiers, with the response
+ *                 planes their features are read from
+ * @classifiersNo: number of classifiers
+ *
+ * A filter used at several positions of the sample has its response
+ * computed once, on a plane covering all of them: each feature is a
+ * shifted view of the plane. The trees read their features straight from
+ * the planes, one tile of pixels at a time.
+ */
+class CompiledModel {
+public:
+    /**
+     * CompiledModel() - Gather the distinct filters of a set of boosted
+     *                   classifiers
+     *
+     * @classifiers: classifiers to evaluate together
+     */
+    CompiledModel(const std::vector< const BoostedClassifier * >
+                  &classifiers);
+
+    /**
+     * classifyFullImage() - Classify all the points of an image with each
+     *                       classifier
+     *
+     * @imgVec     : vector containing the channels associated with the
+     *               image
+     * @borderSize : size of the border that has to be excluded from the
+     *               results
+     *
+     * @predictions: computed result image of each classifier
+     *
+     * @mask       : optional mask of the pixels to classify, the other ones
+     *               being left to 0 (an empty mask includes all the pixels)
+     *
+     * The image is processed by bands of rows, which bounds the memory
+     * taken by the response planes. Rows, columns and tiles holding no
+     * pixel to classify are neither filtered nor walked through the trees.
+     */
+    void classifyFullImage(const std::vector< ImageBuffer > &imgVec,
+                           const unsigned int borderSize,
+                           std::vector< EMat > &predictions,
+                           const EByteMat *mask = nullptr) const;
+
+    /**
+     * setBandBytes() - Set the memory taken at once by the response planes
+     *                  of an image being classified
+     *
+     * @bytes: memory bound, in bytes (256MB by default)
+     *
+     * The bound holds for each classifyFullImage() call: when images are
+     * classified concurrently, the overall budget is split among them.
+     */
+    static void setBandBytes(const size_t bytes);
+
+    /**
+     * getKernelsNo() - Get the number of distinct filters of the model
+     *
+     * Return: number of distinct filters
+     */
+    unsigned int getKernelsNo() const;
+
+    /**
+     * getFeaturesNo() - Get the number of features read by the weak
+     *                   learners of the model
+     *
+     * Return: number of features
+     */
+    unsigned int getFeaturesNo() const;
+
+private:
+    /**
+     * struct uniqueKernel - Distinct filter of the model
+     *
+     * @chNo     : channel on which the filter is applied
+     * @kernel   : filter weights, with the smallest row and column at which
+     *             the filter is used in the sample
+     * @rowSpread: distance between the smallest and the largest rows at
+     *             which the filter is used
+     * @colSpread: distance between the smallest and the largest columns at
+     *             which the filter is used
+     */
+    typedef struct uniqueKernel {
+        unsigned int chNo;
+        convKernel kernel;
+        unsigned int rowSpread;
+        unsigned int colSpread;
+    } uniqueKernel;
+
+    /**
+     * struct kernelUse - Feature read from the response plane of a distinct
+     *                    filter
+     *
+     * @kernel: number of the distinct filter
+     * @row   : row of the feature in the response plane
+     * @col   : column of the feature in the response plane
+     */
+    typedef struct kernelUse {
+        unsigned int kernel;
+        unsigned int row;
+        unsigned int col;
+    } kernelUse;
+
+    /**
+     * struct learnerUses - Features of a weak learner
+     *
+     * @learner   : weak learner
+     * @classifier: number of the classifier the weak learner belongs to
+     * @features  : features read by the filter bank of the weak learner, in
+     *              filter bank order
+     */
+    typedef struct learnerUses {
+        const WeakLearner *learner;
+        unsigned int classifier;
+        std::vector< kernelUse > features;
+    } learnerUses;
+
+    /**
+     * struct featureRef - Location of a feature in the response plane of
+     *                     its filter, for the current band of rows
+     *
+     * @base  : value of the feature on the first pixel of the band
+     * @stride: distance between two rows of the response plane
+     */
+    typedef struct featureRef {
+        const float *base;
+        size_t stride;
+    } featureRef;
+
+    /**
+     * computePlanes() - Compute the response planes of the distinct filters
+     *                   on a band of rows
+     *
+     * @imgVec    : vector containing the channels associated with the image
+     * @borderSize: size of the border that has to be excluded from the
+     *              results
+     * @firstRow  : first row of the band
+     * @firstCol  : first column of the band
+     * @rows      : number of rows of the band
+     * @cols      : number of columns of the band
+     *
+     * @planes    : response plane of each distinct filter
+     */
+    void computePlanes(const std::vector< ImageBuffer > &imgVec,
+                       const unsigned int borderSize,
+                       const unsigned int firstRow,
+                       const unsigned int firstCol,
+                       const unsigned int rows,
+                       const unsigned int cols,
+                       std::vector< EMat > &planes) const;
+
+    std::vector< uniqueKernel > kernels;
+    std::vector< learnerUses > learners;
+    unsigned int classifiersNo;
+};
+
+#endif /* COMPILED_MODEL_HPP_ */
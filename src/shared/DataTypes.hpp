@@ -20,7 +20,12 @@
 #ifndef DATATYPES_HPP_
 #define DATATYPES_HPP_
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <vector>
 
 #pragma GCC diagnostic ignored "-Wsign-conversion"
@@ -36,40 +41,55 @@ typedef Eigen::Matrix< double, Eigen::Dynamic,
                        Eigen::Dynamic, Eigen::RowMajor > EMatD;
 typedef Eigen::VectorXd EVecD;
 
-typedef std::vector< EMat > dataVector;
-typedef std::vector< dataVector > dataChannels;
-typedef std::vector< EMat > maskVector;
+/* Compact planes for masks and original gts (8-bit values) and for gt labels
+   (-1, 0 or 1) */
+typedef Eigen::Matrix< unsigned char, Eigen::Dynamic,
+                       Eigen::Dynamic, Eigen::RowMajor > EByteMat;
+typedef Eigen::Matrix< signed char, Eigen::Dynamic,
+                       Eigen::Dynamic, Eigen::RowMajor > ELabelMat;
 
-typedef std::vector< EMat > gtVector;
+/* Immutable planes, shared by the datasets derived from the one that built
+   them (an empty pointer stands for an empty plane) */
+typedef std::shared_ptr< const EByteMat > sharedByteMat;
+typedef std::shared_ptr< const ELabelMat > sharedLabelMat;
+
+typedef std::vector< sharedByteMat > maskVector;
+
+typedef std::vector< sharedLabelMat > gtVector;
 typedef std::vector< gtVector > gtPairs;
 
 /**
  * struct samplePos - Sampling position for a patch
  *
- * @imageNo: image number for the sample
- * @row    : starting row of the sample
- * @col    : starting column of the sample
- * @label  : label corresponding to the center of the sample
+ * @imageNo  : image number for the sample
+ * @row      : starting row of the sample
+ * @col      : starting column of the sample
+ * @label    : label corresponding to the center of the sample
+ * @transform: geometric transform (rotation/flip) applied on the fly to the
+ *             sample when it is gathered (0 for none)
  */
 typedef struct samplePos {
     unsigned int imageNo;
     unsigned int row;
     unsigned int col;
     int label;
+    unsigned int transform;
 
     /**
      * samplePos() - Build a sample position from its components
      *
-     * @imageNo: image number for the sample
-     * @row    : starting row of the sample
-     * @col    : starting column of the sample
-     * @label  : label corresponding to the center of the sample
+     * @imageNo  : image number for the sample
+     * @row      : starting row of the sample
+     * @col      : starting column of the sample
+     * @label    : label corresponding to the center of the sample
+     * @transform: geometric transform applied to the sample
      */
     samplePos(const unsigned int imgNo,
               const unsigned int r,
               const unsigned int c,
-              const int lbl) :
-        imageNo(imgNo), row(r), col(c), label(lbl) { };
+              const int lbl,
+              const unsigned int tr = 0) :
+        imageNo(imgNo), row(r), col(c), label(lbl), transform(tr) { };
 
     /**
      * samplePos() - Create an uninitialized sample position element
@@ -84,7 +104,7 @@ typedef struct samplePos {
     samplePos(const samplePos& other) :
         imageNo(other.imageNo),
         row(other.row), col(other.col),
-        label(other.label) { };
+        label(other.label), transform(other.transform) { };
 
     /**
      * operator==() - Compare two sample positions for equality
@@ -101,7 +121,8 @@ typedef struct samplePos {
         return (s1.imageNo == s2.imageNo &&
                 s1.row == s2.row &&
                 s1.col == s2.col &&
-                s1.label == s2.label);
+                s1.label == s2.label &&
+                s1.transform == s2.transform);
     }
 
     /**
@@ -120,6 +141,215 @@ typedef struct samplePos {
     }
 } samplePos;
 
-typedef std::vector< samplePos > sampleSet;
+/* Largest image number/row/column that a sampleSet can hold */
+#define SAMPLE_SET_MAX_COORD UINT16_MAX
+
+/**
+ * class sampleSet - Set of sampling positions, stored as a structure of
+ *                   arrays with narrow types so that walking over the
+ *                   samples streams through memory
+ *
+ * Elements are read back as samplePos values: the set has to be modified
+ * through set()/push_back() rather than through references to its elements.
+ *
+ * @imageNos  : image number of each sample
+ * @rows      : starting row of each sample
+ * @cols      : starting column of each sample
+ * @labels    : label of each sample
+ * @transforms: geometric transform of each sample
+ */
+class sampleSet {
+public:
+    /**
+     * sampleSet() - Create an empty sample set
+     */
+    sampleSet() { };
+
+    /**
+     * sampleSet() - Create a sample set holding the given number of
+     *               (zeroed) sample positions
+     *
+     * @n: number of sample positions
+     */
+    explicit sampleSet(const size_t n) { resize(n); };
+
+    size_t size() const { return imageNos.size(); };
+    bool empty() const { return imageNos.empty(); };
+
+    /**
+     * resize() - Resize the set, zeroing the added positions
+     *
+     * @n: new number of sample positions
+     */
+    void
+    resize(const size_t n)
+    {
+        imageNos.resize(n, 0);
+        rows.resize(n, 0);
+        cols.resize(n, 0);
+        labels.resize(n, 0);
+        transforms.resize(n, 0);
+    };
+
+    /**
+     * reserve() - Reserve the space for the given number of positions
+     *
+     * @n: number of sample positions
+     */
+    void
+    reserve(const size_t n)
+    {
+        imageNos.reserve(n);
+        rows.reserve(n);
+        cols.reserve(n);
+        labels.reserve(n);
+        transforms.reserve(n);
+    };
+
+    void
+    clear()
+    {
+        resize(0);
+    };
+
+    /**
+     * operator[]() - Read a sample position
+     *
+     * @i: index of the sample position
+     *
+     * Return: a copy of the i-th sample position
+     */
+    samplePos
+    operator[](const size_t i) const
+    {
+        return samplePos(imageNos[i], rows[i], cols[i], labels[i],
+                         transforms[i]);
+    };
+
+    /**
+     * set() - Overwrite a sample position
+     *
+     * @i: index of the sample position
+     * @s: new value of the sample position
+     */
+    void
+    set(const size_t i, const samplePos &s)
+    {
+        assert (s.imageNo <= SAMPLE_SET_MAX_COORD &&
+                s.row <= SAMPLE_SET_MAX_COORD &&
+                s.col <= SAMPLE_SET_MAX_COORD &&
+                s.transform <= UINT8_MAX);
+        imageNos[i] = s.imageNo;
+        rows[i] = s.row;
+        cols[i] = s.col;
+        labels[i] = s.label;
+        transforms[i] = s.transform;
+    };
+
+    /**
+     * push_back() - Append a sample position at the end of the set
+     *
+     * @s: sample position to append
+     */
+    void
+    push_back(const samplePos &s)
+    {
+        resize(size()+1);
+        set(size()-1, s);
+    };
+
+    /**
+     * append() - Append all the positions of another set at the end of the
+     *            set
+     *
+     * @other: set to append
+     */
+    void
+    append(const sampleSet &other)
+    {
+        imageNos.insert(imageNos.end(),
+                        other.imageNos.begin(), other.imageNos.end());
+        rows.insert(rows.end(), other.rows.begin(), other.rows.end());
+        cols.insert(cols.end(), other.cols.begin(), other.cols.end());
+        labels.insert(labels.end(), other.labels.begin(), other.labels.end());
+        transforms.insert(transforms.end(),
+                          other.transforms.begin(), other.transforms.end());
+    };
+
+    unsigned int imageNo(const size_t i) const { return imageNos[i]; };
+    unsigned int row(const size_t i) const { return rows[i]; };
+    unsigned int col(const size_t i) const { return cols[i]; };
+    int label(const size_t i) const { return labels[i]; };
+    unsigned int transform(const size_t i) const { return transforms[i]; };
+
+    /**
+     * sortIndexes() - Sort a list of indexes in the set so that the
+     *                 positions they refer to are ordered by image, row and
+     *                 column (the sorted list is the permutation back to
+     *                 the original order)
+     *
+     * @idxs: indexes to sort
+     */
+    void
+    sortIndexes(std::vector< unsigned int > &idxs) const
+    {
+        /* Ties keep their relative order */
+        std::vector< std::pair< uint64_t, unsigned int > > keys(idxs.size());
+        for (size_t i = 0; i < idxs.size(); ++i) {
+            keys[i].first = ((uint64_t)imageNos[idxs[i]] << 32) |
+                ((uint64_t)rows[idxs[i]] << 16) | cols[idxs[i]];
+            keys[i].second = idxs[i];
+        }
+        std::sort(keys.begin(), keys.end());
+        for (size_t i = 0; i < idxs.size(); ++i) {
+            idxs[i] = keys[i].second;
+        }
+    };
+
+    /**
+     * sortByPosition() - Reorder the set by image, row and column
+     *
+     * @order: output permutation: the i-th sorted position was at index
+     *         order[i] before sorting
+     */
+    void
+    sortByPosition(std::vector< unsigned int > &order)
+    {
+        order.resize(size());
+        std::iota(order.begin(), order.end(), 0);
+        sortIndexes(order);
+
+        sampleSet sorted(size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted.set(i, (*this)[order[i]]);
+        }
+        *this = std::move(sorted);
+    };
+
+private:
+    std::vector< uint16_t > imageNos;
+    std::vector< uint16_t > rows;
+    std::vector< uint16_t > cols;
+    std::vector< int8_t > labels;
+    std::vector< uint8_t > transforms;
+};
+
+/**
+ * struct pointRun - Horizontal run of consecutive points of an image
+ *
+ * @row   : row of the run
+ * @col   : first column of the run
+ * @length: number of points in the run
+ */
+typedef struct pointRun {
+    unsigned int row;
+    unsigned int col;
+    unsigned int length;
+} pointRun;
+
+typedef std::vector< pointRun > runSet;
+
+/* Immutable set of point runs, shared like the planes above */
+typedef std::shared_ptr< const runSet > sharedRunSet;
 
 #endif /* DATATYPES_HPP_ */
@@ -20,17 +20,46 @@
 #include <iostream>
 #include <chrono>
 #include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
 
-#include <omp.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "Dataset.hpp"
 #include "DataTypes.hpp"
+#include "ImageReader.hpp"
 #include "logging.hpp"
 #include "macros.hpp"
+#include "scheduler.hpp"
+#include "simd.hpp"
 #include "utils.hpp"
 #include "Parameters.hpp"
 
 #include "BoostedClassifier.hpp"
+#include "CompiledModel.hpp"
+
+/**
+ * checkSampleableSize() - Check that the positions of a rescaled image fit
+ *                         in a sampleSet
+ *
+ * @mask   : rescaled mask of the image
+ * @imageID: image ID (corresponding to its position)
+ *
+ * Return: -EXIT_FAILURE if the image is too large, EXIT_SUCCESS otherwise
+ */
+static int
+checkSampleableSize(const cv::Mat &mask, const unsigned int imageID)
+{
+    if (mask.rows > SAMPLE_SET_MAX_COORD+1 ||
+        mask.cols > SAMPLE_SET_MAX_COORD+1) {
+        log_err("Image %d is too large once rescaled (%dx%d, limit: %d)",
+                imageID+1, mask.rows, mask.cols, SAMPLE_SET_MAX_COORD+1);
+        return -EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
 Dataset::Dataset(const Parameters &params)
     : imagesNo(0)
@@ -39,61 +68,37 @@ Dataset::Dataset(const Parameters &params)
     sampleSize = params.sampleSize;
     borderSize = 2*(sampleSize-1);
 
-    if (checkChannelPresent("GAUSSIAN_FILTERING", params.channelList)) {
-        imageOps.push_back(&Dataset::gaussianFiltering);
-    }
-    if (checkChannelPresent("IMAGE_GRAY_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageGrayCh);
-    }
-    if (checkChannelPresent("IMAGE_CLAHE", params.channelList)) {
-        imageOps.push_back(&Dataset::imageCLAHE);
-    }
-    if (checkChannelPresent("IMAGE_GREEN_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageGreenCh);
-    }
-    if (checkChannelPresent("IMAGE_RED_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageRedCh);
-    }
-    if (checkChannelPresent("IMAGE_BLUE_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageBlueCh);
-    }
-    if (checkChannelPresent("IMAGE_HUE_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageHueCh);
-    }
-    if (checkChannelPresent("IMAGE_SATUR_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageSaturCh);
-    }
-    if (checkChannelPresent("IMAGE_VALUE_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageValueCh);
-    }
-    if (checkChannelPresent("IMAGE_L_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageLCh);
-    }
-    if (checkChannelPresent("IMAGE_A_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageACh);
-    }
-    if (checkChannelPresent("IMAGE_B_CH", params.channelList)) {
-        imageOps.push_back(&Dataset::imageBCh);
-    }
-    if (checkChannelPresent("LAPLACIAN_FILTERING", params.channelList)) {
-        imageOps.push_back(&Dataset::laplacianFiltering);
-    }
-    if (checkChannelPresent("LBP", params.channelList)) {
-        imageOps.push_back(&Dataset::LBP);
-    }
-    if (checkChannelPresent("MEDIAN_FILTERING", params.channelList)) {
-        imageOps.push_back(&Dataset::medianFiltering);
-    }
-    if (checkChannelPresent("SOBEL_DRV_X", params.channelList)) {
-        imageOps.push_back(&Dataset::sobelDrvX);
-    }
-    if (checkChannelPresent("SOBEL_DRV_Y", params.channelList)) {
-        imageOps.push_back(&Dataset::sobelDrvY);
+    /* The cache key covers every parameter affecting the data computed
+       from the images */
+    cache = ChannelCache(params.channelCacheDir);
+    cacheRecipe = FNV_OFFSET_BASIS;
+    ChannelCache::hashBytes(&CHANNEL_CACHE_VERSION,
+                            sizeof(CHANNEL_CACHE_VERSION), cacheRecipe);
+
+    imageOpsSources = 0;
+    for (unsigned int i = 0; channelDescrs[i].name != NULL; ++i) {
+        if (checkChannelPresent(channelDescrs[i].name, params.channelList)) {
+            imageOps.push_back(channelDescrs[i].op);
+            imageOpsSources |= channelDescrs[i].sources;
+            ChannelCache::hashBytes(channelDescrs[i].name,
+                                    strlen(channelDescrs[i].name)+1,
+                                    cacheRecipe);
+        }
     }
     dataChNo = imageOps.size();
+    compactChannels = params.compactChannels;
 
     data.resize(dataChNo);
 
+    /* Non-resident images are mapped back from the cache */
+    maxResidentImages = params.maxResidentImages;
+    cachedChNo = dataChNo;
+    if (maxResidentImages > 0 && !cache.isEnabled()) {
+        log_err("Bounding the number of resident images requires the "
+                "channel cache");
+        throw std::runtime_error("invalidParameter");
+    }
+
     imgRescaleFactor = params.imgRescaleFactor;
     if (imgRescaleFactor == 0) {
         throw std::runtime_error("Invalid rescale factor: " +
@@ -112,7 +117,26 @@ Dataset::Dataset(const Parameters &params)
 #ifdef MOVABLE_TRAIN
     gtValues = params.gtValues;
     createGtPairs(params.gtValues);
+    ChannelCache::hashBytes(gtValues.data(), gtValues.size()*sizeof(int),
+                            cacheRecipe);
 #endif // MOVABLE_TRAIN
+    ChannelCache::hashBytes(&compactChannels, sizeof(compactChannels),
+                            cacheRecipe);
+    ChannelCache::hashBytes(&imgRescaleFactor, sizeof(imgRescaleFactor),
+                            cacheRecipe);
+    ChannelCache::hashBytes(&sampleSize, sizeof(sampleSize), cacheRecipe);
+    ChannelCache::hashBytes(&fastClassifier, sizeof(fastClassifier),
+                            cacheRecipe);
+    ChannelCache::hashBytes(&RBCdetection, sizeof(RBCdetection),
+                            cacheRecipe);
+    ChannelCache::hashBytes(&houghMinDist, sizeof(houghMinDist), cacheRecipe);
+    ChannelCache::hashBytes(&houghHThresh, sizeof(houghHThresh), cacheRecipe);
+    ChannelCache::hashBytes(&houghLThresh, sizeof(houghLThresh), cacheRecipe);
+    ChannelCache::hashBytes(&houghMinRad, sizeof(houghMinRad), cacheRecipe);
+    ChannelCache::hashBytes(&houghMaxRad, sizeof(houghMaxRad), cacheRecipe);
+
+    log_info("\tUsing %s kernels for the channels computation",
+             getSimdLevelName(getSimdLevel()));
 
     /* Load paths */
     std::vector< std::string > img_paths;
@@ -134,16 +158,31 @@ Dataset::Dataset(const Parameters &params)
         throw std::runtime_error("inconsistentPathList");
     }
 
-    /* Pre-allocate structures */
-    if (params.nRotations > 0) {
-        imagesNo = img_paths.size()*params.nRotations;
+    /* Rotated versions are either stored along with the plain images, or
+       generated on the fly while sampling */
+    if (params.virtualAugmentation) {
+        nRotations = 1;
+        buildTransformOffsets(std::max(params.nRotations, 1U),
+                              params.flipAugmentation);
     } else {
-        imagesNo = img_paths.size();
+        nRotations = std::max(params.nRotations, 1U);
+        buildTransformOffsets(1, false);
+    }
+
+    /* Pre-allocate structures */
+    imagesNo = img_paths.size()*nRotations;
+    if (imagesNo > SAMPLE_SET_MAX_COORD+1 || transformsNo > UINT8_MAX+1) {
+        log_err("Too many images or transforms to sample from "
+                "(images: %d, limit: %d, transforms: %d, limit: %d)",
+                (int)imagesNo, SAMPLE_SET_MAX_COORD+1,
+                (int)transformsNo, UINT8_MAX+1);
+        throw std::runtime_error("tooManyImages");
     }
     originalSizes.resize(imagesNo);
     masks.resize(imagesNo);
     originalGts.resize(imagesNo);
     imagePaths.resize(imagesNo);
+    imageKeys.resize(imagesNo);
     ePoints.resize(imagesNo);
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
         data[i].resize(imagesNo);
@@ -151,38 +190,18 @@ Dataset::Dataset(const Parameters &params)
     for (unsigned int i = 0; i < gtPairsNo; ++i) {
         gts[i].resize(imagesNo);
     }
-    /* Load images */
-#pragma omp parallel for schedule(dynamic)
-    /* Load plain images */
+    /* Load images, along with their rotated versions */
+    std::vector< std::vector< std::string > > paths(img_paths.size());
     for (unsigned int i = 0; i < img_paths.size(); ++i) {
-        log_info("\t\tAdding image %d/%d...",
-                 (int)i+1, (int)img_paths.size());
-        if (addImage(i, img_paths[i], mask_paths[i],
-                     gt_paths[i]) != EXIT_SUCCESS) {
-            log_err("Error encountered while loading image %d/%d",
-                    (int)i+1, (int)img_paths.size());
-            throw std::runtime_error("imageLoading");
-        }
-    }
-
-    /* Load rotated versions of the plain images */
-    for (unsigned int rot = 1; rot < params.nRotations; ++rot) {
-        for (unsigned int i = 0; i < img_paths.size(); ++i) {
-            log_info("\t\tAdding image %d/%d rotation angle %f/360 ...",
-                     (int)i+1, (int)img_paths.size(),
-                     360.0/params.nRotations*rot);
-            if (addRotatedImage(rot*img_paths.size()+i,
-                                360.0/params.nRotations*rot,
-                                img_paths[i], mask_paths[i],
-                                gt_paths[i]) != EXIT_SUCCESS) {
-                log_err("Error encountered while loading image %d/%d",
-                        (int)i+1, (int)img_paths.size());
-                throw std::runtime_error("imageLoading");
-            }
-        }
+        paths[i] = { img_paths[i], mask_paths[i], gt_paths[i] };
     }
+    loadImageFiles(paths, nRotations, params.readerThreadsNo,
+                   params.readerQueueDepth);
+    countSamplePositions();
 
 #else // !MOVABLE_TRAIN
+    buildTransformOffsets(1, false);
+
     if (loadPaths(params, img_paths, mask_paths) != EXIT_SUCCESS) {
         throw std::runtime_error("loadPaths");
     }
@@ -193,28 +212,75 @@ Dataset::Dataset(const Parameters &params)
         throw std::runtime_error("inconsistentPathList");
     }
 
-    /* Pre-allocate structures */
+    /* Streamed images are never kept in memory, nor in the cache */
+    imagesInFlight = params.imagesInFlight;
+    if (imagesInFlight > 0 && maxResidentImages > 0) {
+        log_err("Bounding the number of resident images is not available "
+                "when streaming the images");
+        throw std::runtime_error("invalidParameter");
+    }
+
+    /* Tiles are computed with a margin around them, which makes no sense
+       for candidate points or for channels computed on the whole image */
+    tileSize = params.tileSize;
+    if (tileSize > 0 && fastClassifier) {
+        log_err("Tiled classification is not available with the fast "
+                "classifier");
+        throw std::runtime_error("invalidParameter");
+    }
+    if (tileSize > 0 &&
+        checkChannelPresent("IMAGE_CLAHE", params.channelList)) {
+        log_err("The IMAGE_CLAHE channel cannot be computed by tiles");
+        throw std::runtime_error("invalidParameter");
+    }
+
+    /* Pre-allocate structures (candidate points are classified through
+       sample sets) */
     imagesNo = img_paths.size();
+    if (imagesNo > SAMPLE_SET_MAX_COORD+1) {
+        log_err("Too many images (%d, limit: %d)",
+                (int)imagesNo, SAMPLE_SET_MAX_COORD+1);
+        throw std::runtime_error("tooManyImages");
+    }
     originalSizes.resize(imagesNo);
     masks.resize(imagesNo);
     imagePaths.resize(imagesNo);
+    imageKeys.resize(imagesNo);
     ePoints.resize(imagesNo);
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
         data[i].resize(imagesNo);
     }
+    if (tileSize > 0 || imagesInFlight > 0) {
+        /* Images are read when classified, either tile by tile or one
+           after the other */
+        imagePaths = img_paths;
+        maskPaths = mask_paths;
+        if (tileSize == 0) {
+            /* Streamed images are decoded ahead while the previous ones
+               are being classified */
+            std::vector< std::vector< std::string > > paths(imagesNo);
+            for (unsigned int i = 0; i < imagesNo; ++i) {
+                paths[i] = { img_paths[i], mask_paths[i] };
+            }
+            streamReader = std::make_shared< ImageReader >(
+                paths,
+                std::vector< int >{ CV_LOAD_IMAGE_COLOR,
+                                    CV_LOAD_IMAGE_GRAYSCALE },
+                params.readerThreadsNo, params.readerQueueDepth);
+        }
+        initResidency();
+        return;
+    }
     /* Load images */
-#pragma omp parallel for schedule(dynamic)
+    std::vector< std::vector< std::string > > paths(img_paths.size());
     for (unsigned int i = 0; i < img_paths.size(); ++i) {
-        log_info("\t\tAdding image %d/%d...",
-                 (int)i+1, (int)img_paths.size());
-        if (addImage(i, img_paths[i], mask_paths[i]) != EXIT_SUCCESS) {
-            log_err("Error encountered while loading image %d/%d",
-                    (int)i+1, (int)img_paths.size());
-            throw std::runtime_error("imageLoading");
-        }
+        paths[i] = { img_paths[i], mask_paths[i] };
     }
+    loadImageFiles(paths, 1, params.readerThreadsNo,
+                   params.readerQueueDepth);
 #endif // MOVABLE_TRAIN
 
+    initResidency();
 }
 
 #ifdef MOVABLE_TRAIN
@@ -222,22 +288,29 @@ Dataset::Dataset(const Parameters &params,
                  const Dataset &srcDataset,
                  const std::vector< BoostedClassifier * > &boostedClassifiers)
 {
-    /* Copy values from the source dataset */
+    /* Copy values from the source dataset (channels, masks, gts and
+       candidate points are immutable, and shared rather than copied) */
     this->data = srcDataset.data;
     this->dataChNo = srcDataset.dataChNo;
     this->imageOps = srcDataset.imageOps;
+    this->imageOpsSources = srcDataset.imageOpsSources;
+    this->compactChannels = srcDataset.compactChannels;
+    this->cache = srcDataset.cache;
+    this->cacheRecipe = srcDataset.cacheRecipe;
+    this->maxResidentImages = srcDataset.maxResidentImages;
+    this->cachedChNo = srcDataset.cachedChNo;
+    this->imageKeys = srcDataset.imageKeys;
     /*
      * Warning! srcDataset.imagesNo might include additional rotations, and we
-     * are not willing to consider them at this point.
+     * are not willing to consider them at this point (nor the ones generated
+     * on the fly).
      */
-    if (params.nRotations > 0) {
-        this->imagesNo = srcDataset.imagesNo/params.nRotations;
-    } else {
-        this->imagesNo = srcDataset.imagesNo;
-    }
+    this->imagesNo = srcDataset.imagesNo/srcDataset.nRotations;
+    this->nRotations = 1;
     this->imageNames = srcDataset.imageNames;
     this->imagePaths = srcDataset.imagePaths;
     this->sampleSize = srcDataset.sampleSize;
+    buildTransformOffsets(1, false);
     this->borderSize = srcDataset.borderSize;
     this->masks = srcDataset.masks;
     this->ePoints = srcDataset.ePoints;
@@ -262,42 +335,47 @@ Dataset::Dataset(const Parameters &params,
         dataVector tmpVec(imagesNo);
         data.push_back(tmpVec);
     }
+    initResidency();
     log_info("Classifying the images with the learned boosted "
              "classifiers...");
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < imagesNo; ++i) {
+    const CompiledModel stages(std::vector< const BoostedClassifier * >(
+                                   boostedClassifiers.begin(),
+                                   boostedClassifiers.end()));
+    parallelFor(imagesNo, [&](unsigned int i) {
 #ifndef TESTS
         std::chrono::time_point< std::chrono::system_clock > start;
         std::chrono::time_point< std::chrono::system_clock > end;
         start = std::chrono::system_clock::now();
 #endif // !TESTS
 
+        /* Scores are kept in float, whatever the storage of the image
+           channels */
+        EMat result;
         if (fastClassifier) {
             for (unsigned int bc = 0;
                  bc < boostedClassifiers.size(); ++bc) {
                 boostedClassifiers[bc]->classifyImage(*this,
                                                       i,
-                                                      ePoints[i],
-                                                      data[dataChNo+bc][i]);
+                                                      getEPoints(i),
+                                                      result);
+                data[dataChNo+bc][i] = ChannelPlane(result);
 #ifndef TESTS
-                saveClassifiedImage(data[dataChNo+bc][i],
+                saveClassifiedImage(result,
                                     params.intermedResDir[bc],
-                                    imageNames[i],
-                                    borderSize);
+                                    imageNames[i]);
 #endif // !TESTS
             }
         } else {
-            std::vector< cv::Mat > chs;
+            std::vector< ImageBuffer > chs;
             getChsForImage(i, chs);
+            std::vector< EMat > results;
+            stages.classifyFullImage(chs, borderSize, results);
             for (unsigned int bc = 0; bc < boostedClassifiers.size(); ++bc) {
-                boostedClassifiers[bc]->classifyFullImage(chs,
-                                                          borderSize,
-                                                          data[dataChNo+bc][i]);
+                data[dataChNo+bc][i] = ChannelPlane(results[bc]);
 #ifndef TESTS
-                saveClassifiedImage(data[dataChNo+bc][i],
+                saveClassifiedImage(results[bc],
                                     params.intermedResDir[bc],
-                                    imageNames[i],
-                                    borderSize);
+                                    imageNames[i]);
 #endif // !TESTS
 
             }
@@ -309,7 +387,7 @@ Dataset::Dataset(const Parameters &params,
         log_info("\t\tImage %d/%d DONE! (took %.3fs)",
                  i+1, imagesNo, elapsed_s.count());
 #endif // !TESTS
-    }
+    });
     dataChNo += boostedClassifiers.size();
 
     /* Finally, alter the ground-truth by setting as positive class the last
@@ -333,16 +411,19 @@ Dataset::Dataset(const Parameters &params,
     gtPairValues = newGtPairValues;
     gtValues = newGtValues;
     gtPairsNo = 1;
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < imagesNo; ++i) {
-        for (unsigned int r = 0; r < gts[0][i].rows(); ++r) {
-            for (unsigned int c = 0; c < gts[0][i].cols(); ++c) {
-                if (gts[0][i](r, c) == IGN_GT_CLASS) {
-                    gts[0][i](r, c) = NEG_GT_CLASS;
+    /* The gts are shared with the source dataset: alter a copy */
+    parallelFor(imagesNo, [&](unsigned int i) {
+        ELabelMat gt = *gts[0][i];
+        for (unsigned int r = 0; r < gt.rows(); ++r) {
+            for (unsigned int c = 0; c < gt.cols(); ++c) {
+                if (gt(r, c) == IGN_GT_CLASS) {
+                    gt(r, c) = NEG_GT_CLASS;
                 }
             }
         }
-    }
+        gts[0][i] = std::make_shared< ELabelMat >(std::move(gt));
+    });
+    countSamplePositions();
 }
 #else // !MOVABLE_TRAIN
 
@@ -353,14 +434,23 @@ Dataset::Dataset(const Parameters &params,
 Dataset::Dataset(const Dataset &srcDataset,
                  const std::vector< BoostedClassifier * > &boostedClassifiers)
 {
-    /* Copy values from the source dataset */
+    /* Copy values from the source dataset (channels, masks, gts and
+       candidate points are immutable, and shared rather than copied) */
     this->data = srcDataset.data;
     this->dataChNo = srcDataset.dataChNo;
     this->imageOps = srcDataset.imageOps;
+    this->imageOpsSources = srcDataset.imageOpsSources;
+    this->compactChannels = srcDataset.compactChannels;
+    this->cache = srcDataset.cache;
+    this->cacheRecipe = srcDataset.cacheRecipe;
+    this->maxResidentImages = srcDataset.maxResidentImages;
+    this->cachedChNo = srcDataset.cachedChNo;
+    this->imageKeys = srcDataset.imageKeys;
     this->imagesNo = srcDataset.imagesNo;
     this->imageNames = srcDataset.imageNames;
     this->imagePaths = srcDataset.imagePaths;
     this->sampleSize = srcDataset.sampleSize;
+    buildTransformOffsets(1, false);
     this->borderSize = srcDataset.borderSize;
     this->masks = srcDataset.masks;
     this->ePoints = srcDataset.ePoints;
@@ -373,6 +463,11 @@ Dataset::Dataset(const Dataset &srcDataset,
     this->fastClassifier = srcDataset.fastClassifier;
     this->RBCdetection = srcDataset.RBCdetection;
     this->useAutoContext = srcDataset.useAutoContext;
+    this->tileSize = srcDataset.tileSize;
+    this->maskPaths = srcDataset.maskPaths;
+    this->imgRescaleFactor = srcDataset.imgRescaleFactor;
+    this->imagesInFlight = srcDataset.imagesInFlight;
+    this->streamReader = srcDataset.streamReader;
 
     /*
      * Now iterate on the images, and for each image and each boosted
@@ -382,33 +477,26 @@ Dataset::Dataset(const Dataset &srcDataset,
         dataVector tmpVec(imagesNo);
         data.push_back(tmpVec);
     }
+    initResidency();
+    stagesModel = std::make_shared< const CompiledModel >(
+        std::vector< const BoostedClassifier * >(boostedClassifiers.begin(),
+                                                 boostedClassifiers.end()));
+    if (imagesInFlight > 0) {
+        /* Images are classified as they are loaded */
+        stageClassifiers = boostedClassifiers;
+        dataChNo += boostedClassifiers.size();
+        return;
+    }
     log_info("Classifying the images with the learned boosted "
              "classifiers...");
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < imagesNo; ++i) {
+    parallelFor(imagesNo, [&](unsigned int i) {
 #ifndef TESTS
         std::chrono::time_point< std::chrono::system_clock > start;
         std::chrono::time_point< std::chrono::system_clock > end;
         start = std::chrono::system_clock::now();
 #endif // !TESTS
 
-        if (fastClassifier) {
-            for (unsigned int bc = 0;
-                 bc < boostedClassifiers.size(); ++bc) {
-                boostedClassifiers[bc]->classifyImage(*this,
-                                                      i,
-                                                      ePoints[i],
-                                                      data[dataChNo+bc][i]);
-            }
-        } else {
-            std::vector< cv::Mat > chs;
-            getChsForImage(i, chs);
-            for (unsigned int bc = 0; bc < boostedClassifiers.size(); ++bc) {
-                boostedClassifiers[bc]->classifyFullImage(chs,
-                                                          borderSize,
-                                                          data[dataChNo+bc][i]);
-            }
-        }
+        classifyStages(i, boostedClassifiers, dataChNo);
 
 #ifndef TESTS
         end = std::chrono::system_clock::now();
@@ -416,14 +504,111 @@ Dataset::Dataset(const Dataset &srcDataset,
         log_info("\t\tImage %d/%d DONE! (took %.3fs)",
                  i+1, imagesNo, elapsed_s.count());
 #endif // !TESTS
-    }
+    });
     dataChNo += boostedClassifiers.size();
 }
 
+/* Extend a mask to the pixels lying within radius of an included one */
+static void
+dilateMask(const EByteMat &mask, const unsigned int radius,
+           EByteMat &dilated)
+{
+    dilated.resize(mask.rows(), mask.cols());
+    if (mask.size() == 0) {
+        return;
+    }
+    const cv::Mat src(mask.rows(), mask.cols(), CV_8UC1,
+                      const_cast< unsigned char * >(mask.data()));
+    cv::Mat dst(dilated.rows(), dilated.cols(), CV_8UC1, dilated.data());
+    cv::dilate(src, dst,
+               cv::getStructuringElement(cv::MORPH_RECT,
+                                         cv::Size(2*radius+1, 2*radius+1)));
+}
+
+void
+Dataset::classifyStages(const unsigned int n,
+                        const std::vector< BoostedClassifier * >
+                        &boostedClassifiers,
+                        const unsigned int baseChNo)
+{
+    /* Scores are kept in float, whatever the storage of the image
+       channels */
+    EMat result;
+    if (fastClassifier) {
+        for (unsigned int bc = 0; bc < boostedClassifiers.size(); ++bc) {
+            boostedClassifiers[bc]->classifyImage(*this,
+                                                  n,
+                                                  getEPoints(n),
+                                                  result);
+            data[baseChNo+bc][n] = ChannelPlane(result);
+        }
+    } else {
+        std::vector< ImageBuffer > chs;
+        getChsForImage(n, baseChNo, chs);
+        /* The final classifier only reads the scores within borderSize of
+           the pixels of the mask */
+        EByteMat stagesMask;
+        dilateMask(getMask(n), borderSize, stagesMask);
+        std::vector< EMat > results;
+        stagesModel->classifyFullImage(chs, borderSize, results,
+                                       &stagesMask);
+        for (unsigned int bc = 0; bc < boostedClassifiers.size(); ++bc) {
+            data[baseChNo+bc][n] = ChannelPlane(results[bc]);
+        }
+    }
+}
+
+int
+Dataset::loadImage(const unsigned int n)
+{
+    /* Tiled images are read while being classified */
+    if (tileSize > 0) {
+        return EXIT_SUCCESS;
+    }
+
+    std::vector< cv::Mat > decoded;
+    if (streamReader->take(n, decoded) != EXIT_SUCCESS) {
+        log_err("Unable to read image %s or its mask",
+                imagePaths[n].c_str());
+        return -EXIT_FAILURE;
+    }
+    if (addImage(n, decoded[0], decoded[1]) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
+    if (!stageClassifiers.empty()) {
+        classifyStages(n, stageClassifiers,
+                       dataChNo-stageClassifiers.size());
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void
+Dataset::releaseImage(const unsigned int n)
+{
+    for (unsigned int ch = 0; ch < dataChNo; ++ch) {
+        data[ch][n] = ChannelPlane();
+    }
+    masks[n].reset();
+    ePoints[n].reset();
+}
+
+bool
+Dataset::isStreamed() const
+{
+    return imagesInFlight > 0;
+}
+
+unsigned int
+Dataset::getImagesInFlight() const
+{
+    return imagesInFlight;
+}
+
 #endif // MOVABLE_TRAIN
 
 #ifdef MOVABLE_TRAIN
-const EMat&
+const ELabelMat&
 Dataset::getGt(const int pairNo,
                const unsigned int imageNo) const
 {
@@ -432,11 +617,15 @@ Dataset::getGt(const int pairNo,
         log_err("The requested gt %d does not exist in "
                 "pair %d (limits: image = %d, pair = %d)",
                 imageNo, pairNo, imagesNo-1, gtPairsNo-1);
-        /* Return an empty EMat */
-        static EMat nullresult;
+        /* Return an empty plane */
+        static ELabelMat nullresult;
+        return nullresult;
+    }
+    if (!gts[pairNo][imageNo]) {
+        static ELabelMat nullresult;
         return nullresult;
     }
-    return gts[pairNo][imageNo];
+    return *gts[pairNo][imageNo];
 }
 
 int
@@ -474,17 +663,21 @@ Dataset::getGtVector(const int pairNo) const
     return gts[pairNo];
 }
 
-const EMat&
+const EByteMat&
 Dataset::getOriginalGt(const unsigned int imageNo) const
 {
     if (imageNo >= imagesNo) {
         log_err("The requested original gt (%d) does not exist",
                 imageNo);
-        /* Return an empty EMat */
-        static EMat nullresult;
+        /* Return an empty plane */
+        static EByteMat nullresult;
         return nullresult;
     }
-    return originalGts[imageNo];
+    if (!originalGts[imageNo]) {
+        static EByteMat nullresult;
+        return nullresult;
+    }
+    return *originalGts[imageNo];
 }
 
 bool
@@ -510,6 +703,53 @@ Dataset::getGtValuesNo() const
 
 #endif // MOVABLE_TRAIN
 
+void
+Dataset::gatherSample(const ChannelPlane &img,
+                      const samplePos &s,
+                      const unsigned int rowOffset,
+                      const unsigned int colOffset,
+                      const unsigned int size,
+                      float *dst) const
+{
+    const int nRows = img.rows();
+    const int nCols = img.cols();
+    const int startCol = s.col+colOffset;
+
+    if (s.transform != 0) {
+        /* Rotated/flipped sample: follow the precomputed offsets of
+           the transform, relative to the sample position */
+        assert(s.transform < transformOffsets.size());
+        assert(rowOffset+size <= sampleSize &&
+               colOffset+size <= sampleSize);
+        const sampleOffsets &offsets = transformOffsets[s.transform];
+        for (unsigned int r = 0; r < size; ++r) {
+            const unsigned int base = (rowOffset+r)*sampleSize+colOffset;
+            for (unsigned int c = 0; c < size; ++c) {
+                dst[c] = img.at(reflectIndex(s.row+offsets.rows[base+c],
+                                             nRows),
+                                reflectIndex(s.col+offsets.cols[base+c],
+                                             nCols));
+            }
+            dst += size;
+        }
+        return;
+    }
+
+    /* Stored values are expanded to float while gathering */
+    for (unsigned int r = 0; r < size; ++r) {
+        const int row = reflectIndex(s.row+rowOffset+r, nRows);
+        if (startCol+(int)size <= nCols) {
+            img.getRowSegment(row, startCol, size, dst);
+        } else {
+            /* The patch crosses the right border of the image */
+            for (unsigned int c = 0; c < size; ++c) {
+                dst[c] = img.at(row, reflectIndex(startCol+c, nCols));
+            }
+        }
+        dst += size;
+    }
+}
+
 void Dataset::getSampleMatrix(const sampleSet &samplePositions,
                               const std::vector< unsigned int > &samplesIdx,
                               const unsigned int chNo,
@@ -524,13 +764,71 @@ void Dataset::getSampleMatrix(const sampleSet &samplePositions,
     const unsigned int sampleArea = size*size;
 
     samples.resize(samplesNo, sampleArea);
+    /* The plane is fetched again only when the image changes (samples
+       grouped by image touch each image once) */
+    ChannelPlane img;
+    unsigned int imgNo = imagesNo;
+    for (unsigned int iX = 0; iX < samplesNo; ++iX) {
+        const samplePos s = samplePositions[samplesIdx[iX]];
+        if (s.imageNo != imgNo) {
+            img = getPlane(chNo, s.imageNo);
+            imgNo = s.imageNo;
+        }
+        gatherSample(img, s, rowOffset, colOffset, size,
+                     samples.row(iX).data());
+    }
+}
+
+void
+Dataset::getSampleResponses(const sampleSet &samplePositions,
+                            const std::vector< unsigned int > &samplesIdx,
+                            const unsigned int chNo,
+                            const unsigned int rowOffset,
+                            const unsigned int colOffset,
+                            const unsigned int size,
+                            const EMat &filter,
+                            EVec &responses) const
+{
+    assert (chNo < dataChNo);
+    assert ((unsigned int)filter.size() == size*size);
+
+    const unsigned int samplesNo = samplesIdx.size();
+    const float *w = filter.data();
+
+    /* Per-row sums of the filter, needed to apply the offset of the
+       stored codes once per row rather than once per pixel */
+    std::vector< float > rowSumW(size);
+    for (unsigned int r = 0; r < size; ++r) {
+        rowSumW[r] = std::accumulate(w+r*size, w+(r+1)*size, 0.0f);
+    }
+    /* Scratch buffer for the samples that cannot be read in place */
+    std::vector< float > patch(size*size);
+
+    responses.resize(samplesNo);
+    ChannelPlane img;
+    unsigned int imgNo = imagesNo;
     for (unsigned int iX = 0; iX < samplesNo; ++iX) {
-        const samplePos &s = samplePositions[samplesIdx[iX]];
-        EMat tmp = data[chNo][s.imageNo].block(s.row+rowOffset,
-                                               s.col+colOffset,
-                                               size, size);
-        samples.row(iX) = Eigen::Map< EMat >(tmp.data(), 1,
-                                             sampleArea);
+        const samplePos s = samplePositions[samplesIdx[iX]];
+        if (s.imageNo != imgNo) {
+            img = getPlane(chNo, s.imageNo);
+            imgNo = s.imageNo;
+        }
+        const int startCol = s.col+colOffset;
+
+        if (s.transform != 0 || startCol+size > img.cols()) {
+            gatherSample(img, s, rowOffset, colOffset, size, patch.data());
+            responses(iX) = dotF32(patch.data(), w, size*size);
+            continue;
+        }
+
+        /* Rows are contiguous in the plane: multiply them in place */
+        float acc = 0;
+        for (unsigned int r = 0; r < size; ++r) {
+            const int row = reflectIndex(s.row+rowOffset+r, img.rows());
+            acc += img.dotRowSegment(row, startCol, size, w+r*size,
+                                     rowSumW[r]);
+        }
+        responses(iX) = acc;
     }
 }
 
@@ -548,7 +846,7 @@ Dataset::shrinkSamplePositions(sampleSet &samplePositions,
     sampleSet newSamples(desiredSize);
 
     for (unsigned int i = 0; i < desiredSize; ++i) {
-        newSamples[i] = samplePositions[newSamplesPos[i]];
+        newSamples.set(i, samplePositions[newSamplesPos[i]]);
     }
 
     samplePositions = newSamples;
@@ -561,23 +859,335 @@ Dataset::getBorderSize() const
 }
 
 void
-Dataset::getChsForImage(const unsigned int n, std::vector< cv::Mat > &chs) const
+Dataset::getChsForImage(const unsigned int n,
+                        std::vector< ImageBuffer > &chs) const
+{
+    getChsForImage(n, dataChNo, chs);
+}
+
+void
+Dataset::getChsForImage(const unsigned int n,
+                        const unsigned int chNo,
+                        std::vector< ImageBuffer > &chs) const
 {
     chs.clear();
-    for (unsigned int ch = 0; ch < dataChNo; ++ch) {
-        cv::Mat img(data[ch][n].rows(),
-                    data[ch][n].cols(),
-                    CV_32FC1);
-        cv::eigen2cv(data[ch][n], img);
-        cv::copyMakeBorder(img, img,
-                           borderSize, borderSize,
-                           borderSize, borderSize,
-                           cv::BORDER_REFLECT);
+    for (unsigned int ch = 0; ch < chNo; ++ch) {
+        const ChannelPlane src = getPlane(ch, n);
+        const int nRows = src.rows();
+        const int nCols = src.cols();
+        ImageBuffer img(nRows+2*borderSize, nCols+2*borderSize);
+
+        /* Expand each row in place, then resolve the reflected border with
+           index arithmetic on the expanded row */
+        for (int r = 0; r < img.rows(); ++r) {
+            float *dstRow = img.ptr(r);
+            float *center = dstRow+borderSize;
+            src.getRowSegment(reflectIndex(r-(int)borderSize, nRows),
+                              0, nCols, center);
+            for (unsigned int c = 0; c < borderSize; ++c) {
+                dstRow[c] = center[reflectIndex((int)c-(int)borderSize,
+                                                nCols)];
+                center[nCols+c] = center[reflectIndex(nCols+c, nCols)];
+            }
+        }
+        chs.push_back(img);
+    }
+}
+
+#ifndef MOVABLE_TRAIN
+static inline cv::Rect
+enlargeRect(const cv::Rect &rect, const int margin)
+{
+    return cv::Rect(rect.x-margin, rect.y-margin,
+                    rect.width+2*margin, rect.height+2*margin);
+}
+
+/**
+ * mapScratchPlane() - Map a zeroed float plane on an anonymous scratch file
+ *
+ * @rows  : number of rows of the plane
+ * @cols  : number of columns of the plane
+ * @memory: mapped values (unmapped, and the file removed, once released)
+ *
+ * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
+ */
+static int
+mapScratchPlane(const int rows, const int cols,
+                std::shared_ptr< unsigned char > &memory)
+{
+    const size_t size = std::max((size_t)rows*cols*sizeof(float),
+                                 (size_t)1);
+    FILE *fp = tmpfile();
+    if (fp == NULL) {
+        log_err("Unable to create a scratch file for the scores");
+        return -EXIT_FAILURE;
+    }
+    void *addr = MAP_FAILED;
+    if (ftruncate(fileno(fp), size) == 0) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fileno(fp), 0);
+    }
+    fclose(fp);
+    if (addr == MAP_FAILED) {
+        log_err("Unable to map a scratch file for the scores");
+        return -EXIT_FAILURE;
+    }
+    memory.reset(static_cast< unsigned char * >(addr),
+                 [size](unsigned char *p) { munmap(p, size); });
+
+    return EXIT_SUCCESS;
+}
+
+int
+Dataset::classifyImageTiled(const unsigned int n,
+                            const std::vector< BoostedClassifier * >
+                            &boostedClassifiers,
+                            const BoostedClassifier &finalClassifier,
+                            ChannelPlane &result)
+{
+    cv::Mat img;
+    if (loadTiledImage(n, img) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
+
+    const cv::Rect imageRect(0, 0, img.cols, img.rows);
+    const int side = tileSize;
+    std::vector< cv::Rect > cores;
+    for (int r = 0; r < img.rows; r += side) {
+        for (int c = 0; c < img.cols; c += side) {
+            cores.push_back(cv::Rect(c, r, side, side) & imageRect);
+        }
+    }
+
+    /* First pass: gather the moments of the channels on the cores of the
+       tiles, which partition the image */
+    std::vector< channelNorm > norms(imageOps.size(), channelNorm());
+    std::mutex normsLock;
+    parallelFor(cores.size(), [&](unsigned int t) {
+        const cv::Rect region =
+            enlargeRect(cores[t], TILE_CHANNELS_HALO) & imageRect;
+        std::vector< channelNorm > tileNorms(imageOps.size(), channelNorm());
+        for (unsigned int i = 0; i < tileNorms.size(); ++i) {
+            tileNorms[i].collect = true;
+            tileNorms[i].core = cores[t]-region.tl();
+        }
+        dataVector planes;
+        if (computeTileChannels(img, region, tileNorms,
+                                planes) != EXIT_SUCCESS) {
+            throw std::runtime_error("tileChannels");
+        }
+        std::lock_guard< std::mutex > guard(normsLock);
+        for (unsigned int i = 0; i < norms.size(); ++i) {
+            norms[i].sum += tileNorms[i].sum;
+            norms[i].sumSq += tileNorms[i].sumSq;
+            norms[i].count += tileNorms[i].count;
+        }
+    });
+    for (unsigned int i = 0; i < norms.size(); ++i) {
+        norms[i].mean = norms[i].sum/norms[i].count;
+        norms[i].stdDev = sqrt(std::max(norms[i].sumSq/norms[i].count-
+                                        norms[i].mean*norms[i].mean, 0.0));
+    }
+
+    /* Second pass: classify each tile. Every stage of classifiers reads
+       borderSize pixels around the pixels it classifies, and the channel
+       operations TILE_CHANNELS_HALO pixels around the ones they compute */
+    const int stagesNo = boostedClassifiers.empty() ? 1 : 2;
+    const int halo = stagesNo*(int)borderSize+(int)TILE_CHANNELS_HALO;
+    const CompiledModel stages(std::vector< const BoostedClassifier * >(
+                                   boostedClassifiers.begin(),
+                                   boostedClassifiers.end()));
+    const CompiledModel &finalModel = finalClassifier.getCompiledModel();
+    const EByteMat &mask = getMask(n);
+
+    /* Scores are written tile by tile to a scratch file, the kernel
+       writing the pages back instead of keeping them in memory */
+    std::shared_ptr< unsigned char > scoresMemory;
+    if (mapScratchPlane(img.rows, img.cols, scoresMemory) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
+    float *scoresData = reinterpret_cast< float * >(scoresMemory.get());
+    parallelFor(cores.size(), [&](unsigned int t) {
+        const cv::Rect &core = cores[t];
+
+        /* Tiles lying outside the mask are left to 0, their channels are
+           not even computed */
+        const EByteMat coreMask =
+            mask.block(core.y, core.x, core.height, core.width);
+        if (!(coreMask.array() == (unsigned char)MASK_INCLUDED).any()) {
+            return;
+        }
+
+        const cv::Rect region = enlargeRect(core, halo) & imageRect;
+        std::vector< channelNorm > tileNorms = norms;
+        dataVector planes;
+        if (computeTileChannels(img, region, tileNorms,
+                                planes) != EXIT_SUCCESS) {
+            throw std::runtime_error("tileChannels");
+        }
+
+        std::vector< ImageBuffer > chs;
+        if (!boostedClassifiers.empty()) {
+            /* AutoContext: the scores of the individual pairs are needed
+               on the tile enlarged by the border of the final classifier */
+            const cv::Rect scoresRect =
+                enlargeRect(core, borderSize) & imageRect;
+            getChsForWindow(planes, region, scoresRect, borderSize,
+                            img.size(), chs);
+            /* The final classifier only reads the scores within
+               borderSize of the pixels of the mask */
+            const cv::Rect dilatedRect =
+                enlargeRect(scoresRect, borderSize) & imageRect;
+            EByteMat dilatedMask;
+            dilateMask(mask.block(dilatedRect.y, dilatedRect.x,
+                                  dilatedRect.height, dilatedRect.width),
+                       borderSize, dilatedMask);
+            const EByteMat scoresMask =
+                dilatedMask.block(scoresRect.y-dilatedRect.y,
+                                  scoresRect.x-dilatedRect.x,
+                                  scoresRect.height, scoresRect.width);
+            std::vector< EMat > tileScores;
+            stages.classifyFullImage(chs, borderSize, tileScores,
+                                     &scoresMask);
+            dataVector scores;
+            for (unsigned int bc = 0; bc < tileScores.size(); ++bc) {
+                scores.push_back(ChannelPlane(tileScores[bc]));
+            }
+            chs.clear();
+            getChsForWindow(planes, region, core, borderSize, img.size(),
+                            chs);
+            getChsForWindow(scores, scoresRect, core, borderSize,
+                            img.size(), chs);
+        } else {
+            getChsForWindow(planes, region, core, borderSize, img.size(),
+                            chs);
+        }
+
+        std::vector< EMat > tileResult;
+        finalModel.classifyFullImage(chs, borderSize, tileResult, &coreMask);
+        for (int r = 0; r < core.height; ++r) {
+            std::copy(tileResult[0].row(r).data(),
+                      tileResult[0].row(r).data()+core.width,
+                      scoresData+(size_t)(core.y+r)*img.cols+core.x);
+        }
+    });
+    result = ChannelPlane(img.rows, img.cols, PLANE_FLOAT32, 1.0, 0.0,
+                          scoresMemory);
+
+    return EXIT_SUCCESS;
+}
+
+bool
+Dataset::isTiled() const
+{
+    return tileSize > 0;
+}
+
+int
+Dataset::loadTiledImage(const unsigned int imageID, cv::Mat &img)
+{
+    const cv::Mat srcImg = cv::imread(imagePaths[imageID],
+                                      CV_LOAD_IMAGE_COLOR);
+    const cv::Mat srcMask = cv::imread(maskPaths[imageID],
+                                       CV_LOAD_IMAGE_GRAYSCALE);
+    if (srcImg.empty() || srcMask.empty()) {
+        log_err("Unable to read image %s or its mask",
+                imagePaths[imageID].c_str());
+        return -EXIT_FAILURE;
+    }
+
+    /* Rescale mask and image as addImage() does, the image is converted
+       to float only one tile at a time */
+    originalSizes[imageID] = std::make_pair(srcMask.rows, srcMask.cols);
+
+    cv::Mat mask;
+    cv::resize(srcMask, mask, cv::Size(0, 0),
+               1.0/(double)imgRescaleFactor,
+               1.0/(double)imgRescaleFactor,
+               cv::INTER_NEAREST);
+    if (checkSampleableSize(mask, imageID) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
+
+    cv::Mat tmp;
+    mask.convertTo(tmp, CV_32FC1);
+    addMask(imageID, tmp);
+
+    cv::resize(srcImg, img, cv::Size(mask.cols, mask.rows), 0, 0,
+               cv::INTER_LANCZOS4);
+
+    return EXIT_SUCCESS;
+}
+
+int
+Dataset::computeTileChannels(const cv::Mat &img,
+                             const cv::Rect &region,
+                             std::vector< channelNorm > &norms,
+                             dataVector &planes) const
+{
+    /* Convert the region to float and rescale it in [0, 1] */
+    cv::Mat tile;
+    img(region).convertTo(tile, CV_32FC3);
+    tile = tile/255;
+
+    channelSources sources;
+    computeChannelSources(tile, imageOpsSources, sources);
+    planes.resize(imageOps.size());
+    for (unsigned int i = 0; i < imageOps.size(); ++i) {
+        const channelOpArgs args = { compactChannels, &norms[i] };
+        if (imageOps[i](sources, planes[i], &args) != EXIT_SUCCESS) {
+            log_err("Unable to compute channel %d on a tile", i);
+            return -EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void
+Dataset::getChsForWindow(const dataVector &planes,
+                         const cv::Rect &planesRect,
+                         const cv::Rect &window,
+                         const unsigned int border,
+                         const cv::Size &imageSize,
+                         std::vector< ImageBuffer > &chs)
+{
+    const int b = border;
+    const int left = window.x-b;
+    const int right = window.x+window.width+b;
+
+    /* Columns of the enlarged window falling inside the image */
+    const int firstCol = std::max(left, 0);
+    const int lastCol = std::min(right, imageSize.width);
+
+    for (unsigned int ch = 0; ch < planes.size(); ++ch) {
+        const ChannelPlane &src = planes[ch];
+        ImageBuffer img(window.height+2*b, window.width+2*b);
+
+        /* Expand the columns inside the image in place, then resolve the
+           reflected ones with index arithmetic on the expanded row */
+        for (int r = 0; r < img.rows(); ++r) {
+            const int srcRow =
+                reflectIndex(window.y-b+r, imageSize.height)-planesRect.y;
+            float *dstRow = img.ptr(r);
+            float *inside = dstRow+(firstCol-left);
+            src.getRowSegment(srcRow, firstCol-planesRect.x,
+                              lastCol-firstCol, inside);
+            for (int c = left; c < firstCol; ++c) {
+                dstRow[c-left] =
+                    inside[reflectIndex(c, imageSize.width)-firstCol];
+            }
+            for (int c = lastCol; c < right; ++c) {
+                dstRow[c-left] =
+                    inside[reflectIndex(c, imageSize.width)-firstCol];
+            }
+        }
         chs.push_back(img);
     }
 }
+#endif // !MOVABLE_TRAIN
 
-const EMat&
+ChannelPlane
 Dataset::getData(const unsigned int channelNo,
                  const unsigned int imageNo) const
 {
@@ -585,11 +1195,10 @@ Dataset::getData(const unsigned int channelNo,
         log_err("The requested image %d does not exist in "
                 "channel %d (limits: image = %d, channel = %d)",
                 imageNo, channelNo, imagesNo-1, dataChNo-1);
-        /* Return an empty EMat */
-        static EMat nullresult;
-        return nullresult;
+        /* Return an empty plane */
+        return ChannelPlane();
     }
-    return data[channelNo][imageNo];
+    return getPlane(channelNo, imageNo);
 }
 
 unsigned int
@@ -598,33 +1207,22 @@ Dataset::getDataChNo() const
     return dataChNo;
 }
 
-const dataVector&
-Dataset::getDataVector(const unsigned int channelNo) const
-{
-    if (channelNo >= dataChNo) {
-        log_err("The requested data vector does not exist "
-                "channel = %d, max value = %d)",
-                channelNo, dataChNo-1);
-        /* Return an empty vector if the wrong channel number is
-           requested */
-        static dataVector nullresult;
-        return nullresult;
-    }
-    return data[channelNo];
-}
-
-const sampleSet&
+const runSet&
 Dataset::getEPoints(const unsigned int imageNo) const
 {
     if (imageNo >= imagesNo) {
         log_err("The requested image %d does not exist "
                 "(limit: image = %d)",
                 imageNo, imagesNo-1);
-        /* Return an empty sampleSet */
-        static sampleSet nullresult;
+        /* Return an empty runSet */
+        static runSet nullresult;
+        return nullresult;
+    }
+    if (!ePoints[imageNo]) {
+        static runSet nullresult;
         return nullresult;
     }
-    return ePoints[imageNo];
+    return *ePoints[imageNo];
 }
 
 std::string
@@ -655,18 +1253,22 @@ Dataset::getImagesNo() const
     return imagesNo;
 }
 
-const EMat&
+const EByteMat&
 Dataset::getMask(const unsigned int imageNo) const
 {
     if (imageNo >= imagesNo) {
         log_err("The requested image %d does not exist "
                 "(limit: image = %d)",
                 imageNo, imagesNo-1);
-        /* Return an empty EMat */
-        static EMat nullresult;
+        /* Return an empty plane */
+        static EByteMat nullresult;
         return nullresult;
     }
-    return masks[imageNo];
+    if (!masks[imageNo]) {
+        static EByteMat nullresult;
+        return nullresult;
+    }
+    return *masks[imageNo];
 }
 
 std::pair< int, int >
@@ -761,17 +1363,9 @@ Dataset::computeCandidatePointsMask(const unsigned int imageID,
     cv::threshold(VLAB[0], VLAB[0], th_L, 255, cv::THRESH_BINARY_INV);
     cv::threshold(VLAB[2], VLAB[2], th_b, 255, cv::THRESH_BINARY_INV);
 
-    cv::Mat thresholdedBinImage(colorImg.size(), CV_8UC1);
-    thresholdedBinImage = cv::Scalar(0);
-
-    for (int r = 0; r < colorImg.rows; ++r) {
-        for (int c = 0; c < colorImg.cols; ++c) {
-            if (VLAB[0].at< uchar >(r,c) > 0 ||
-                VLAB[2].at< uchar >(r,c) > 0) {
-                thresholdedBinImage.at< uchar >(r,c) = 255;
-            }
-        }
-    }
+    /* Both thresholded planes are binary (0 or 255) */
+    cv::Mat thresholdedBinImage;
+    cv::bitwise_or(VLAB[0], VLAB[2], thresholdedBinImage);
 
     cv::Mat eroded;
     // cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
@@ -839,31 +1433,27 @@ Dataset::computeCandidatePointsMask(const unsigned int imageID,
         cv::Mat dstRBC(dst.rows, dst.cols, CV_8U);
         dstRBC = cv::Scalar(0);
 
+        /* Each circle is rasterised on a buffer covering its bounding box
+           only */
+        cv::Mat roi_rbc;
+        cv::Mat roi_region;
         for (size_t i = 0; i < RBCs.size(); ++i) {
             cv::Vec3i c = RBCs[i];
-            cv::Mat tmp(dst.rows, dst.cols, CV_8U);
-            tmp = cv::Scalar(0);
-            cv::circle(tmp, cv::Point(c[0], c[1]),
+            const cv::Range rows(std::max(c[1]-c[2], 0),
+                                 std::min(c[1]+c[2], dst.rows-1));
+            const cv::Range cols(std::max(c[0]-c[2], 0),
+                                 std::min(c[0]+c[2], dst.cols-1));
+            if (rows.size() <= 0 || cols.size() <= 0) {
+                continue;
+            }
+
+            roi_rbc.create(rows.size(), cols.size(), CV_8U);
+            roi_rbc = cv::Scalar(0);
+            cv::circle(roi_rbc, cv::Point(c[0]-cols.start, c[1]-rows.start),
                        c[2], cv::Scalar(255),
                        -1, cv::LINE_8);
 
-            cv::Mat roi_rbc = tmp(cv::Range(std::max(c[1]-c[2],
-                                                     0),
-                                            std::min(c[1]+c[2],
-                                                     dst.rows-1)),
-                                  cv::Range(std::max(c[0]-c[2],
-                                                     0),
-                                            std::min(c[0]+c[2],
-                                                     dst.cols-1)));
-            cv::Mat roi_detection = dst(cv::Range(std::max(c[1]-c[2],
-                                                           0),
-                                                  std::min(c[1]+c[2],
-                                                           dst.rows-1)),
-                                        cv::Range(std::max(c[0]-c[2],
-                                                           0),
-                                                  std::min(c[0]+c[2],
-                                                           dst.cols-1)));
-            cv::Mat roi_region;
+            cv::Mat roi_detection = dst(rows, cols);
             cv::bitwise_and(roi_rbc, roi_detection, roi_region);
             if (cv::countNonZero(roi_region) > 0) {
                 cv::circle(dstRBC,
@@ -904,10 +1494,6 @@ Dataset::computeCandidatePointsMask(const unsigned int imageID,
                cv::INTER_NEAREST);
     cv::bitwise_and(dst, mask, dst);
 
-    cv::copyMakeBorder(dst, dst,
-                       borderSize, borderSize, borderSize, borderSize,
-                       cv::BORDER_CONSTANT, cv::Scalar(0));
-
     // cv::Mat replicated;
     // cv::cvtColor(dst, replicated, CV_GRAY2BGR);
     // cv::Mat overlayed;
@@ -937,16 +1523,28 @@ Dataset::computeCandidatePointsMask(const unsigned int imageID,
     //  cnt, dst.rows*dst.cols);
     // cv::waitKey();
 
-    sampleSet eDst;
+    /* Store the candidates as runs of consecutive points along the rows,
+       skipping over the zero and nonzero spans with vector compares */
+    runSet eDst;
+    const unsigned int cols = (unsigned int)dst.cols;
     for (int r = 0; r < dst.rows; ++r) {
-        for (int c = 0; c < dst.cols; ++c) {
-            if (dst.at< uchar >(r, c) > 0) {
-                eDst.push_back(samplePos(imageID, r, c, 0));
+        const uchar *row = dst.ptr< uchar >(r);
+        unsigned int c = 0;
+        while (c < cols) {
+            c += findZeroU8(row+c, cols-c, false);
+            const unsigned int start = c;
+            c += findZeroU8(row+c, cols-c, true);
+            if (c > start) {
+                pointRun run;
+                run.row = r;
+                run.col = start;
+                run.length = c-start;
+                eDst.push_back(run);
             }
         }
     }
 
-    ePoints[imageID] = eDst;
+    ePoints[imageID] = std::make_shared< runSet >(std::move(eDst));
 }
 
 #ifdef MOVABLE_TRAIN
@@ -954,124 +1552,266 @@ Dataset::computeCandidatePointsMask(const unsigned int imageID,
 int
 Dataset::addGt(const unsigned int imageID, const cv::Mat &src)
 {
-    /* Enlarge the original GT image and store it */
-    cv::Mat oSrc;
-    cv::copyMakeBorder(src, oSrc,
-                       borderSize, borderSize, borderSize, borderSize,
-                       cv::BORDER_CONSTANT, IGN_GT_CLASS);
-    EMat oTmp(oSrc.rows, oSrc.cols);
-    cv::cv2eigen(oSrc, oTmp);
-    originalGts[imageID] = oTmp;
-
+    /* Label of each 8-bit gt value in each pair (row GT_LUT_OTHER collects
+       the values that are not exact gt values, such as those interpolated
+       while rotating the gt) */
+    std::vector< signed char > lut((GT_LUT_OTHER+1)*gtPairsNo,
+                                   IGN_GT_CLASS);
     for (unsigned int i = 0; i < gtPairsNo; ++i) {
-        cv::Mat tmp(src.rows, src.cols, CV_32FC1);
-        tmp = IGN_GT_CLASS;
-
-        /* Scan each pixel and set the GT value accordingly */
-        for (unsigned int r = 0; r < (unsigned int)src.rows; ++r) {
-            for (unsigned int c = 0; c < (unsigned int)src.cols; ++c) {
-                if (src.at< float >(r, c) == gtPairValues[i].first) {
-                    tmp.at< float >(r, c) = NEG_GT_CLASS;
-                }
+        const int neg = gtPairValues[i].first;
+        const int pos = gtPairValues[i].second;
+        if (neg >= 0 && neg < GT_LUT_OTHER) {
+            lut[neg*gtPairsNo+i] = NEG_GT_CLASS;
+        }
+        if (pos >= 0 && pos < GT_LUT_OTHER) {
+            lut[pos*gtPairsNo+i] = POS_GT_CLASS;
+        }
+    }
 
-                if (src.at< float >(r, c) == gtPairValues[i].second) {
-                    tmp.at< float >(r, c) = POS_GT_CLASS;
-                }
+    /* Build the original GT and the labels of all the pairs in a single
+       pass */
+    EByteMat original(src.rows, src.cols);
+    std::vector< ELabelMat > labels(gtPairsNo,
+                                    ELabelMat(src.rows, src.cols));
+    for (int r = 0; r < src.rows; ++r) {
+        const float *srcRow = src.ptr< float >(r);
+        for (int c = 0; c < src.cols; ++c) {
+            const float value = srcRow[c];
+            const int code = (value >= 0 && value < GT_LUT_OTHER &&
+                              value == (int)value) ?
+                (int)value : GT_LUT_OTHER;
+            const signed char *pairLabels = &lut[code*gtPairsNo];
+            original(r, c) = cv::saturate_cast< uchar >(value);
+            for (unsigned int i = 0; i < gtPairsNo; ++i) {
+                labels[i](r, c) = pairLabels[i];
             }
         }
+    }
 
-        cv::copyMakeBorder(tmp, tmp,
-                           borderSize, borderSize, borderSize, borderSize,
-                           cv::BORDER_CONSTANT, IGN_GT_CLASS);
-
-        EMat eTmp(tmp.rows, tmp.cols);
-        cv::cv2eigen(tmp, eTmp);
-        gts[i][imageID] = eTmp;
-
+    originalGts[imageID] = std::make_shared< EByteMat >(std::move(original));
+    for (unsigned int i = 0; i < gtPairsNo; ++i) {
 #ifdef VISUALIZE_IMG_DATA
         cv::namedWindow("InGt", cv::WINDOW_NORMAL);
         cv::imshow("InGt", src);
         cv::namedWindow("OutGt", cv::WINDOW_NORMAL);
-        cv::imshow("OutGt", tmp);
+        cv::imshow("OutGt", cv::Mat(src.rows, src.cols, CV_8SC1,
+                                    labels[i].data()));
         cv::waitKey(0);
 #endif // VISUALIZE_IMG_DATA
+        gts[i][imageID] = std::make_shared< ELabelMat >(std::move(labels[i]));
     }
 
     return EXIT_SUCCESS;
 }
 #endif // MOVABLE_TRAIN
 
+void
+Dataset::loadImageFiles(const std::vector< std::vector< std::string > > &paths,
+                        const unsigned int rotationsNo,
+                        const unsigned int readersNo,
+                        const unsigned int queueDepth)
+{
+    const unsigned int baseImagesNo = paths.size();
+
+    /* Load from the cache what it holds first, to decode only the images
+       that have to be computed */
+    std::vector< imageVersions > versions(baseImagesNo);
+    parallelFor(baseImagesNo, [&](unsigned int i) {
+        if (loadCachedImageFiles(i, baseImagesNo, rotationsNo, paths[i],
+                                 versions[i]) != EXIT_SUCCESS) {
+            log_err("Error encountered while loading image %d/%d",
+                    (int)i+1, (int)baseImagesNo);
+            throw std::runtime_error("imageLoading");
+        }
+    });
+    std::vector< unsigned int > toDecode;
+    std::vector< std::vector< std::string > > decodePaths;
+    for (unsigned int i = 0; i < baseImagesNo; ++i) {
+        const std::vector< bool > &done = versions[i].done;
+        if (std::find(done.begin(), done.end(), false) != done.end()) {
+            toDecode.push_back(i);
+            decodePaths.push_back(paths[i]);
+        }
+    }
+    if (toDecode.empty()) {
+        return;
+    }
+
+    /* Groundtruth and mask are assumed to be grayscale, and a color image
+       is always read: it will be the loop over the operations that will
+       grab the different components */
+    std::vector< int > flags = { CV_LOAD_IMAGE_COLOR,
+                                 CV_LOAD_IMAGE_GRAYSCALE };
 #ifdef MOVABLE_TRAIN
+    flags.push_back(CV_LOAD_IMAGE_GRAYSCALE);
+#endif // MOVABLE_TRAIN
+    ImageReader reader(decodePaths, flags, readersNo, queueDepth);
+
+    /* The scheduler hands the images out in order, as the reader decodes
+       them */
+    parallelFor(toDecode.size(), [&](unsigned int i) {
+        const unsigned int imageNo = toDecode[i];
+        log_info("\t\tAdding image %d/%d (%d rotations)...",
+                 (int)imageNo+1, (int)baseImagesNo, (int)rotationsNo);
+        std::vector< cv::Mat > decoded;
+        if (reader.take(i, decoded) != EXIT_SUCCESS ||
+            addImageFiles(versions[imageNo], decoded) != EXIT_SUCCESS) {
+            log_err("Error encountered while loading image %d/%d",
+                    (int)imageNo+1, (int)baseImagesNo);
+            throw std::runtime_error("imageLoading");
+        }
+    });
+}
+
 int
-Dataset::addImage(const unsigned int imageID,
-                  const std::string &imgPath,
-                  const std::string &maskPath,
-                  const std::string &gtPath)
-#else // !MOVABLE_TRAIN
+Dataset::loadCachedImageFiles(const unsigned int imageNo,
+                              const unsigned int baseImagesNo,
+                              const unsigned int rotationsNo,
+                              const std::vector< std::string > &paths,
+                              imageVersions &versions)
+{
+    for (unsigned int i = 0; i < paths.size(); ++i) {
+        CHECK_FILE_EXISTS(paths[i].c_str());
+    }
+
+    /* Rotated versions are stored after all the plain images */
+    versions.imageNo = imageNo;
+    versions.imageIDs.resize(rotationsNo);
+    versions.angles.resize(rotationsNo);
+    for (unsigned int rot = 0; rot < rotationsNo; ++rot) {
+        versions.imageIDs[rot] = rot*baseImagesNo+imageNo;
+        versions.angles[rot] = 360.0/rotationsNo*rot;
+        imagePaths[versions.imageIDs[rot]] = paths[0];
+    }
+
+    /* Fetch from the cache the versions that have already been computed */
+    versions.cacheKeys.assign(rotationsNo, 0);
+    versions.done.assign(rotationsNo, false);
+    versions.useCache = false;
+    if (cache.isEnabled()) {
+        uint64_t filesKey;
+        versions.useCache = computeCacheKey(paths, filesKey) == EXIT_SUCCESS;
+        for (unsigned int rot = 0;
+             versions.useCache && rot < rotationsNo; ++rot) {
+            const unsigned int imageID = versions.imageIDs[rot];
+            uint64_t &key = versions.cacheKeys[rot];
+            key = filesKey;
+            ChannelCache::hashBytes(&versions.angles[rot],
+                                    sizeof(versions.angles[rot]), key);
+            versions.done[rot] = loadCachedImage(imageID, key);
+            if (versions.done[rot] && maxResidentImages > 0) {
+                releaseChannels(imageID, key);
+            }
+        }
+    }
+    if (maxResidentImages > 0 && !versions.useCache) {
+        log_err("Unable to compute the cache key of %s", paths[0].c_str());
+        return -EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 int
-Dataset::addImage(const unsigned int imageID,
-                  const std::string &imgPath,
-                  const std::string &maskPath)
-#endif // MOVABLE_TRAIN
+Dataset::addImageFiles(const imageVersions &versions,
+                       const std::vector< cv::Mat > &decoded)
 {
-    CHECK_FILE_EXISTS(imgPath.c_str());
-    CHECK_FILE_EXISTS(maskPath.c_str());
+    /* The input files are decoded once, all the versions are derived from
+       them */
+    const cv::Mat &img = decoded[0];
+    const cv::Mat &mask = decoded[1];
 #ifdef MOVABLE_TRAIN
-    CHECK_FILE_EXISTS(gtPath.c_str());
+    const cv::Mat &gt = decoded[2];
 #endif // MOVABLE_TRAIN
 
-    /* Groundtruth and mask are assumed to be grayscale */
-    cv::Mat mask = cv::imread(maskPath.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
+    for (unsigned int rot = 0; rot < versions.imageIDs.size(); ++rot) {
+        if (versions.done[rot]) {
+            continue;
+        }
+        const unsigned int imageID = versions.imageIDs[rot];
+#ifdef MOVABLE_TRAIN
+        const int ret = rot == 0 ?
+            addImage(imageID, img, mask, gt) :
+            addRotatedImage(imageID, versions.angles[rot], img, mask, gt);
+#else // !MOVABLE_TRAIN
+        const int ret = addImage(imageID, img, mask);
+#endif // MOVABLE_TRAIN
+        if (ret != EXIT_SUCCESS) {
+            return ret;
+        }
+        if (!versions.useCache) {
+            continue;
+        }
+        /* Non-resident images can only be read back from the cache */
+        if (storeCachedImage(imageID, versions.cacheKeys[rot]) !=
+            EXIT_SUCCESS && maxResidentImages > 0) {
+            return -EXIT_FAILURE;
+        }
+        if (maxResidentImages > 0) {
+            releaseChannels(imageID, versions.cacheKeys[rot]);
+        }
+    }
 
+    return EXIT_SUCCESS;
+}
+
+#ifdef MOVABLE_TRAIN
+int
+Dataset::addImage(const unsigned int imageID,
+                  const cv::Mat &srcImg,
+                  const cv::Mat &srcMask,
+                  const cv::Mat &srcGt)
+#else // !MOVABLE_TRAIN
+int
+Dataset::addImage(const unsigned int imageID,
+                  const cv::Mat &srcImg,
+                  const cv::Mat &srcMask)
+#endif // MOVABLE_TRAIN
+{
     /* Rescale mask. Its size will be used to alter the size of the input
        image and the gt */
-    originalSizes[imageID] = std::make_pair(mask.rows, mask.cols);
+    originalSizes[imageID] = std::make_pair(srcMask.rows, srcMask.cols);
 
-    cv::resize(mask, mask, cv::Size(0, 0),
+    cv::Mat mask;
+    cv::resize(srcMask, mask, cv::Size(0, 0),
                1.0/(double)imgRescaleFactor,
                1.0/(double)imgRescaleFactor,
                cv::INTER_NEAREST);
+    if (checkSampleableSize(mask, imageID) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
 
     cv::Mat tmp;
     mask.convertTo(tmp, CV_32FC1);
     addMask(imageID, tmp);
 
-    imagePaths[imageID] = imgPath;
-    /* Always read a color image, it will be the loop over the operations
-       that will grab the different component and eventually keep the
-       grayscale one only */
-    cv::Mat img = cv::imread(imgPath.c_str(), CV_LOAD_IMAGE_COLOR);
     /* Use the image as a source to the algorithm that finds the candidate
        points for classification and stores them in a mask that
        will be later used for the actual classification */
     if (fastClassifier) {
-        computeCandidatePointsMask(imageID, img, mask);
+        computeCandidatePointsMask(imageID, srcImg, mask);
     }
 
-    cv::resize(img, img, cv::Size(mask.cols, mask.rows), 0, 0,
+    cv::Mat img;
+    cv::resize(srcImg, img, cv::Size(mask.cols, mask.rows), 0, 0,
                cv::INTER_LANCZOS4);
 
-    /* Replicate image borders */
-    /* Changed to border mirroring to ease CUDA implementation */
-    cv::copyMakeBorder(img, img,
-                       borderSize, borderSize, borderSize, borderSize,
-                       cv::BORDER_REFLECT);
-
     /* Convert image to float and rescale it in [0, 1] */
     img.convertTo(img, CV_32FC3);
     img = img/255;
 
     /* Now alter the image according to user specifications, creating the
-       corresponding channels */
+       corresponding channels from the shared intermediates */
+    channelSources sources;
+    computeChannelSources(img, imageOpsSources, sources);
+    const channelOpArgs args = { compactChannels, nullptr };
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
-        EMat tmp;
-        imageOps[i](img, tmp, (void *)&borderSize);
-        data[i][imageID] = tmp;
+        imageOps[i](sources, data[i][imageID], &args);
     }
 
     /* Check that all sizes are consistent */
-    const unsigned int rowsNo = masks[imageID].rows();
-    const unsigned int colsNo = masks[imageID].cols();
+    const unsigned int rowsNo = masks[imageID]->rows();
+    const unsigned int colsNo = masks[imageID]->cols();
 
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
         if (data[i][imageID].rows() != rowsNo ||
@@ -1083,14 +1823,13 @@ Dataset::addImage(const unsigned int imageID,
     }
 
 #ifdef MOVABLE_TRAIN
-    cv::Mat gt = cv::imread(gtPath.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-    gt.convertTo(tmp, CV_32FC1);
+    srcGt.convertTo(tmp, CV_32FC1);
     cv::resize(tmp, tmp, cv::Size(mask.cols, mask.rows), 0, 0,
                cv::INTER_NEAREST);
     addGt(imageID, tmp);
     for (unsigned int i = 0; i < gtPairsNo; ++i) {
-        if (gts[i][imageID].rows() != rowsNo ||
-            gts[i][imageID].cols() != colsNo) {
+        if (gts[i][imageID]->rows() != rowsNo ||
+            gts[i][imageID]->cols() != colsNo) {
             log_err("Invalid GT size -- image %d, gt pair %d",
                     imageID+1, i);
             return -EXIT_FAILURE;
@@ -1105,25 +1844,22 @@ Dataset::addImage(const unsigned int imageID,
 int
 Dataset::addRotatedImage(const unsigned int imageID,
                          const double rot,
-                         const std::string &imgPath,
-                         const std::string &maskPath,
-                         const std::string &gtPath)
+                         const cv::Mat &srcImg,
+                         const cv::Mat &srcMask,
+                         const cv::Mat &srcGt)
 {
-    CHECK_FILE_EXISTS(imgPath.c_str());
-    CHECK_FILE_EXISTS(maskPath.c_str());
-    CHECK_FILE_EXISTS(gtPath.c_str());
-
-    /* Groundtruth and mask are assumed to be grayscale */
-    cv::Mat mask = cv::imread(maskPath.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-
     /* Rescale mask. Its size will be used to alter the size of the input
        image and the gt */
-    originalSizes[imageID] = std::make_pair(mask.rows, mask.cols);
+    originalSizes[imageID] = std::make_pair(srcMask.rows, srcMask.cols);
 
-    cv::resize(mask, mask, cv::Size(0, 0),
+    cv::Mat mask;
+    cv::resize(srcMask, mask, cv::Size(0, 0),
                1.0/(double)imgRescaleFactor,
                1.0/(double)imgRescaleFactor,
                cv::INTER_NEAREST);
+    if (checkSampleableSize(mask, imageID) != EXIT_SUCCESS) {
+        return -EXIT_FAILURE;
+    }
 
     /* Compute rotation matrix */
     cv::Point mask_center = cv::Point(mask.cols/2, mask.rows/2);
@@ -1140,21 +1876,15 @@ Dataset::addRotatedImage(const unsigned int imageID,
     cv::Mat cropped_rotated_tmp = rotated_tmp(roi);
     addMask(imageID, cropped_rotated_tmp);
 
-    imagePaths[imageID] = imgPath;
-    /* Always read a color image, it will be the loop over the operations
-       that will grab the different component and eventually keep the
-       grayscale one only */
-    cv::Mat img = cv::imread(imgPath.c_str(), CV_LOAD_IMAGE_COLOR);
-
-    cv::Point img_center = cv::Point(img.cols/2, img.rows/2);
+    cv::Point img_center = cv::Point(srcImg.cols/2, srcImg.rows/2);
     cv::Mat img_rot_mat = cv::getRotationMatrix2D(img_center, rot, 1.0);
 
     /* Rotate image */
-    warpAffine(img, rotated_tmp, img_rot_mat, img.size());
-    roi = cv::Rect((rotated_tmp.cols-img.cols)/2,
-                   (rotated_tmp.rows-img.rows)/2,
-                   img.cols, img.rows);
-    img = rotated_tmp(roi);
+    warpAffine(srcImg, rotated_tmp, img_rot_mat, srcImg.size());
+    roi = cv::Rect((rotated_tmp.cols-srcImg.cols)/2,
+                   (rotated_tmp.rows-srcImg.rows)/2,
+                   srcImg.cols, srcImg.rows);
+    cv::Mat img = rotated_tmp(roi);
 
     /* Use the image as a source to the algorithm that finds the candidate
        points for classification and stores them in a mask that
@@ -1166,26 +1896,22 @@ Dataset::addRotatedImage(const unsigned int imageID,
     cv::resize(img, img, cv::Size(mask.cols, mask.rows), 0, 0,
                cv::INTER_LANCZOS4);
 
-    /* Replicate image borders */
-    cv::copyMakeBorder(img, img,
-                       borderSize, borderSize, borderSize, borderSize,
-                       cv::BORDER_REFLECT);
-
     /* Convert image to float and rescale it in [0, 1] */
     img.convertTo(img, CV_32FC3);
     img = img/255;
 
     /* Now alter the image according to user specifications, creating the
-       corresponding channels */
+       corresponding channels from the shared intermediates */
+    channelSources sources;
+    computeChannelSources(img, imageOpsSources, sources);
+    const channelOpArgs args = { compactChannels, nullptr };
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
-        EMat tmp;
-        imageOps[i](img, tmp, (void *)&borderSize);
-        data[i][imageID] = tmp;
+        imageOps[i](sources, data[i][imageID], &args);
     }
 
     /* Check that all sizes are consistent */
-    const unsigned int rowsNo = masks[imageID].rows();
-    const unsigned int colsNo = masks[imageID].cols();
+    const unsigned int rowsNo = masks[imageID]->rows();
+    const unsigned int colsNo = masks[imageID]->cols();
 
     for (unsigned int i = 0; i < imageOps.size(); ++i) {
         if (data[i][imageID].rows() != rowsNo ||
@@ -1196,9 +1922,8 @@ Dataset::addRotatedImage(const unsigned int imageID,
         }
     }
 
-    cv::Mat gt = cv::imread(gtPath.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-    gt.convertTo(tmp, CV_32FC1);
-    cv::Point gt_center = cv::Point(gt.cols/2, gt.rows/2);
+    srcGt.convertTo(tmp, CV_32FC1);
+    cv::Point gt_center = cv::Point(srcGt.cols/2, srcGt.rows/2);
     cv::Mat gt_rot_mat = cv::getRotationMatrix2D(gt_center, rot, 1.0);
 
     warpAffine(tmp, rotated_tmp, gt_rot_mat, tmp.size());
@@ -1213,8 +1938,8 @@ Dataset::addRotatedImage(const unsigned int imageID,
 
     addGt(imageID, cropped_rotated_tmp);
     for (unsigned int i = 0; i < gtPairsNo; ++i) {
-        if (gts[i][imageID].rows() != rowsNo ||
-            gts[i][imageID].cols() != colsNo) {
+        if (gts[i][imageID]->rows() != rowsNo ||
+            gts[i][imageID]->cols() != colsNo) {
             log_err("Invalid GT size -- image %d, gt pair %d",
                     imageID+1, i);
             return -EXIT_FAILURE;
@@ -1226,46 +1951,70 @@ Dataset::addRotatedImage(const unsigned int imageID,
 #endif // MOVABLE_TRAIN
 
 #ifdef MOVABLE_TRAIN
-unsigned int
-Dataset::collectAllSamplePositions(const gtVector &gt,
-                                   const int sampleClass,
-                                   std::vector< sampleSet > &availableSamples,
-                                   std::vector< int > &samplesPerImageNo) const
+void
+Dataset::countSamplePositions()
 {
-    availableSamples.resize(imagesNo);
-    samplesPerImageNo.resize(imagesNo);
-
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < imagesNo; ++i) {
+    posSampleCounts.assign(gtPairsNo,
+                           std::vector< rowPrefixCounts >(imagesNo));
+    negSampleCounts.assign(gtPairsNo,
+                           std::vector< rowPrefixCounts >(imagesNo));
+
+    parallelFor(gtPairsNo*imagesNo, [&](unsigned int task) {
+        const unsigned int p = task/imagesNo;
+        const unsigned int i = task%imagesNo;
         /* Local aliases to ease manipulations */
-        const EMat &gtImg = gt[i];
-        const EMat &maskImg = masks[i];
-        sampleSet &samples = availableSamples[i];
-        samples.clear();
-
-        /* It is not worth doing the multiplication of the two matrices
-           just to do a single if-comparison, possibly cheaper to do
-           perform the two individual comparisons */
+        const ELabelMat &gtImg = *gts[p][i];
+        const EByteMat &maskImg = *masks[i];
+        rowPrefixCounts &posCounts = posSampleCounts[p][i];
+        rowPrefixCounts &negCounts = negSampleCounts[p][i];
+        posCounts.resize(gtImg.rows()+1);
+        negCounts.resize(gtImg.rows()+1);
+        posCounts[0] = negCounts[0] = 0;
+
         for (unsigned int r = 0; r < (unsigned int)gtImg.rows(); ++r) {
+            unsigned int pos = 0;
+            unsigned int neg = 0;
             for (unsigned int c = 0;
                  c < (unsigned int)gtImg.cols(); ++c) {
-                if (maskImg(r, c) == MASK_INCLUDED &&
-                    gtImg(r, c) == sampleClass) {
-                    samples.push_back(samplePos(i, r, c,
-                                                sampleClass));
+                if (maskImg(r, c) == MASK_INCLUDED) {
+                    pos += gtImg(r, c) == POS_GT_CLASS;
+                    neg += gtImg(r, c) == NEG_GT_CLASS;
                 }
             }
+            posCounts[r+1] = posCounts[r]+pos;
+            negCounts[r+1] = negCounts[r]+neg;
         }
-        samplesPerImageNo[i] = samples.size();
-    }
+    });
+}
 
-    /* Count the total number of available samples */
-    unsigned int availableSamplesNo = 0;
-    for (unsigned int i = 0; i < imagesNo; ++i) {
-        availableSamplesNo += samplesPerImageNo[i];
+void
+Dataset::buildTransformOffsets(const unsigned int rotationsNo,
+                               const bool flips)
+{
+    transformsNo = rotationsNo*(flips ? 2 : 1);
+    transformOffsets.resize(transformsNo);
+
+    /* The sample is rotated around its position, as it happens when the
+       whole image is rotated; rotated pixels are taken from the nearest
+       neighbour */
+    for (unsigned int t = 0; t < transformsNo; ++t) {
+        const double angle = 2*M_PI/rotationsNo*(t%rotationsNo);
+        const double cosA = cos(angle);
+        const double sinA = sin(angle);
+        const bool flip = t >= rotationsNo;
+        sampleOffsets &offsets = transformOffsets[t];
+        offsets.rows.resize(sampleSize*sampleSize);
+        offsets.cols.resize(sampleSize*sampleSize);
+        for (unsigned int r = 0; r < sampleSize; ++r) {
+            for (unsigned int c = 0; c < sampleSize; ++c) {
+                const double dc = flip ? -(double)c : (double)c;
+                offsets.rows[r*sampleSize+c] =
+                    (int)lround(cosA*r+sinA*dc);
+                offsets.cols[r*sampleSize+c] =
+                    (int)lround(-sinA*r+cosA*dc);
+            }
+        }
     }
-
-    return availableSamplesNo;
 }
 
 void
@@ -1299,14 +2048,14 @@ Dataset::getSamplePositions(const int sampleClass,
         return -EXIT_FAILURE;
     }
 
-    return getAvailableSamples(gts[(unsigned int)gtPair],
+    return getAvailableSamples(gtPair,
                                sampleClass,
                                samplesNo,
                                samplePositions);
 }
 
 int
-Dataset::getAvailableSamples(const gtVector &gt,
+Dataset::getAvailableSamples(const unsigned int gtPair,
                              const int sampleClass,
                              const unsigned int samplesNo,
                              sampleSet &samplePositions) const
@@ -1315,35 +2064,98 @@ Dataset::getAvailableSamples(const gtVector &gt,
        return value */
     samplePositions.clear();
 
-    /* Per-image available samples */
-    std::vector< sampleSet > availableSamples;
-    std::vector< int > samplesPerImageNo;
-    const unsigned int availableSamplesNo =
-        collectAllSamplePositions(gt,
-                                  sampleClass,
-                                  availableSamples,
-                                  samplesPerImageNo);
+    /* Per-image available samples, read from the prefix counts */
+    const std::vector< rowPrefixCounts > &counts =
+        sampleClass == POS_GT_CLASS ? posSampleCounts[gtPair] :
+                                      negSampleCounts[gtPair];
+    std::vector< unsigned int > samplesPerImageNo(imagesNo);
+    uint64_t availableSamplesNo = 0;
+    for (unsigned int i = 0; i < imagesNo; ++i) {
+        samplesPerImageNo[i] = counts[i].back();
+        availableSamplesNo += samplesPerImageNo[i];
+    }
 
+    /* Each position can be sampled with any of the on-the-fly transforms.
+       The totals overflow 32 bits on large datasets, whereas the number
+       of draws is bounded by the (32-bit) number of requested samples */
+    const uint64_t distinctSamplesNo = availableSamplesNo*transformsNo;
     const unsigned int returnedSamplesNo =
-        samplesNo <= availableSamplesNo ? samplesNo : availableSamplesNo;
-    samplePositions.resize(returnedSamplesNo);
+        (uint64_t)samplesNo <= distinctSamplesNo ?
+        samplesNo : (unsigned int)distinctSamplesNo;
+    if (returnedSamplesNo == 0) {
+        return 0;
+    }
 
     /* Grab the individual samples from images, sampling according to the
        distribution over the images (that is, more elements of the requested
-       class in an image will provoke more sampling from that image) */
+       class in an image will provoke more sampling from that image). Each
+       draw is the rank of the position among the image's positions of the
+       requested class, in row-major order */
+    typedef struct sampleDraw {
+        unsigned int imageNo;
+        unsigned int rank;
+        unsigned int transform;
+        unsigned int idx;
+    } sampleDraw;
+    std::vector< sampleDraw > draws(returnedSamplesNo);
     std::vector< unsigned int > randSamples =
         randomWeightedSamplingWithReplacement(returnedSamplesNo,
                                               samplesPerImageNo);
     for (unsigned int i = 0; i < returnedSamplesNo; ++i) {
+        /* Images without samples have null weight and are never drawn */
         const unsigned int imgNo = randSamples[i];
-        if (samplesPerImageNo[imgNo] > 0) {
-            samplePositions[i] = availableSamples[imgNo]
-                [(unsigned int)rand() % samplesPerImageNo[imgNo]];
-        } else {
-            /* Cannot get a sample from this image, resample */
-            --i;
+        assert (samplesPerImageNo[imgNo] > 0);
+        draws[i].imageNo = imgNo;
+        /* A single rand() only reaches RAND_MAX, which can be less than
+           the positions of a large image */
+        const uint64_t r = (uint64_t)rand()*((uint64_t)RAND_MAX+1)+
+            (uint64_t)rand();
+        draws[i].rank = (unsigned int)(r % samplesPerImageNo[imgNo]);
+        draws[i].transform = (unsigned int)rand() % transformsNo;
+        draws[i].idx = i;
+    }
+
+    /* Resolve the ranks to positions visiting each image row at most once */
+    std::sort(draws.begin(), draws.end(),
+              [](const sampleDraw &a, const sampleDraw &b) {
+                  return a.imageNo != b.imageNo ? a.imageNo < b.imageNo :
+                                                  a.rank < b.rank;
+              });
+    samplePositions.resize(returnedSamplesNo);
+    unsigned int d = 0;
+    while (d < returnedSamplesNo) {
+        const unsigned int imgNo = draws[d].imageNo;
+        const rowPrefixCounts &rowCounts = counts[imgNo];
+        const ELabelMat &gtImg = *gts[gtPair][imgNo];
+        const EByteMat &maskImg = *masks[imgNo];
+
+        while (d < returnedSamplesNo && draws[d].imageNo == imgNo) {
+            /* Row containing the rank-th position of the class */
+            const unsigned int r =
+                std::upper_bound(rowCounts.begin(), rowCounts.end(),
+                                 draws[d].rank)-rowCounts.begin()-1;
+            /* Scan the row once for all the draws falling in it */
+            unsigned int seen = rowCounts[r];
+            for (unsigned int c = 0; c < (unsigned int)gtImg.cols() &&
+                     d < returnedSamplesNo && draws[d].imageNo == imgNo &&
+                     draws[d].rank < rowCounts[r+1]; ++c) {
+                if (maskImg(r, c) != MASK_INCLUDED ||
+                    gtImg(r, c) != sampleClass) {
+                    continue;
+                }
+                /* Repeated draws of the same rank share the position */
+                while (d < returnedSamplesNo &&
+                       draws[d].imageNo == imgNo && draws[d].rank == seen) {
+                    samplePositions.set(draws[d].idx,
+                                        samplePos(imgNo, r, c, sampleClass,
+                                                  draws[d].transform));
+                    ++d;
+                }
+                ++seen;
+            }
         }
     }
+
     return (int)returnedSamplesNo;
 }
 
@@ -1411,711 +2223,629 @@ Dataset::loadPaths(const Parameters &params,
 }
 
 int
-Dataset::imageGrayCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::computeCacheKey(const std::vector< std::string > &paths,
+                         uint64_t &key) const
 {
-    cv::Mat gray;
-    const unsigned int borderSize = *((unsigned int *)opaque);
+    key = cacheRecipe;
+    for (unsigned int i = 0; i < paths.size(); ++i) {
+        if (ChannelCache::hashFile(paths[i], key) != EXIT_SUCCESS) {
+            return -EXIT_FAILURE;
+        }
+    }
 
-    cv::cvtColor(src, gray, CV_BGR2GRAY);
-    cv::Mat imgCenter = gray(cv::Range(borderSize, gray.rows-borderSize+1),
-                             cv::Range(borderSize, gray.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    gray -= mean[0];
-    gray /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(gray.rows, gray.cols);
-    cv::cv2eigen(gray, dst);
+bool
+Dataset::loadCachedImage(const unsigned int imageID, const uint64_t key)
+{
+    cacheEntry entry;
+    if (!cache.load(key, entry)) {
+        return false;
+    }
+#ifdef MOVABLE_TRAIN
+    const unsigned int gtsNo = gtPairsNo;
+#else // !MOVABLE_TRAIN
+    const unsigned int gtsNo = 0;
+#endif // MOVABLE_TRAIN
+    if (entry.channels.size() != dataChNo || entry.gts.size() != gtsNo) {
+        log_err("Cache entry for image %d does not match the dataset, "
+                "recomputing it", imageID+1);
+        return false;
+    }
 
-#ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("grayCh", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(gray, &min, &max);
-    if (max-min > 1e-4) {
-        gray = (gray-min)/(max-min);
-    } else {
-        gray.setTo(cv::Scalar(0));
+    for (unsigned int i = 0; i < dataChNo; ++i) {
+        data[i][imageID] = entry.channels[i];
     }
-    cv::imshow("grayCh", gray);
-    cv::waitKey(0);
-#endif // VISUALIZE_IMG_DATA
+    masks[imageID] = std::make_shared< EByteMat >(std::move(entry.mask));
+    originalSizes[imageID] = entry.originalSize;
+    ePoints[imageID] = std::make_shared< runSet >(std::move(entry.ePoints));
+#ifdef MOVABLE_TRAIN
+    for (unsigned int i = 0; i < gtPairsNo; ++i) {
+        gts[i][imageID] =
+            std::make_shared< ELabelMat >(std::move(entry.gts[i]));
+    }
+    originalGts[imageID] =
+        std::make_shared< EByteMat >(std::move(entry.originalGt));
+#endif // MOVABLE_TRAIN
 
-    return EXIT_SUCCESS;
+    return true;
 }
 
 int
-Dataset::imageCLAHE(const cv::Mat &src, EMat &dst, const void * /* opaque */)
+Dataset::storeCachedImage(const unsigned int imageID,
+                          const uint64_t key) const
 {
-    cv::Mat gray;
-    cv::Mat tmp;
-    cv::Mat tmp2;
+    cacheEntry entry;
+    for (unsigned int i = 0; i < dataChNo; ++i) {
+        entry.channels.push_back(data[i][imageID]);
+    }
+    entry.mask = *masks[imageID];
+    entry.originalSize = originalSizes[imageID];
+    entry.ePoints = getEPoints(imageID);
+#ifdef MOVABLE_TRAIN
+    for (unsigned int i = 0; i < gtPairsNo; ++i) {
+        entry.gts.push_back(*gts[i][imageID]);
+    }
+    entry.originalGt = *originalGts[imageID];
+#endif // MOVABLE_TRAIN
 
-    cv::cvtColor(src, gray, CV_BGR2GRAY);
+    if (cache.store(key, entry) != EXIT_SUCCESS) {
+        log_err("Unable to cache image %d", imageID+1);
+        return -EXIT_FAILURE;
+    }
 
-    /* Undo float conversion! */
-    gray *= 255;
-    gray.convertTo(tmp, CV_8UC1);
-    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
-    clahe->setClipLimit(4);
-    clahe->apply(tmp, tmp2);
-    tmp2.convertTo(gray, CV_32FC1);
-    gray /= 255;
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(gray.rows, gray.cols);
-    cv::cv2eigen(gray, dst);
+void
+Dataset::releaseChannels(const unsigned int imageID, const uint64_t key)
+{
+    imageKeys[imageID] = key;
+    for (unsigned int i = 0; i < cachedChNo; ++i) {
+        data[i][imageID] = ChannelPlane();
+    }
+}
 
-#ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("CLAHE", cv::WINDOW_NORMAL);
-    cv::imshow("CLAHE", gray);
-    cv::waitKey(0);
-#endif // VISUALIZE_IMG_DATA
+void
+Dataset::initResidency()
+{
+    residentImages.clear();
+    residentPos.resize(imagesNo);
+    isResident.assign(imagesNo, false);
+    if (maxResidentImages == 0 || cachedChNo == 0) {
+        return;
+    }
 
-    return EXIT_SUCCESS;
+    /* Images still in memory are evicted lazily, on the next miss */
+    for (unsigned int i = 0; i < imagesNo; ++i) {
+        if (data[0][i].rows() > 0) {
+            residentPos[i] = residentImages.insert(residentImages.end(), i);
+            isResident[i] = true;
+        }
+    }
 }
 
-int
-Dataset::imageGreenCh(const cv::Mat &src, EMat &dst, const void *opaque)
+/* Residency of the images is shared by all the datasets */
+static std::mutex residencyLock;
+
+ChannelPlane
+Dataset::getPlane(const unsigned int chNo, const unsigned int imageNo) const
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
+    if (maxResidentImages == 0 || chNo >= cachedChNo) {
+        return data[chNo][imageNo];
+    }
+
+    /* The returned copy keeps the mapping alive if the image gets evicted
+       while still in use */
+    ChannelPlane plane;
+    {
+        std::lock_guard< std::mutex > guard(residencyLock);
+        if (isResident[imageNo]) {
+            residentImages.splice(residentImages.begin(), residentImages,
+                                  residentPos[imageNo]);
+        } else {
+            makeResident(imageNo);
+        }
+        plane = data[chNo][imageNo];
+    }
 
-    cv::split(src, colorCh);
+    return plane;
+}
 
-    cv::Mat greenCh = colorCh[1];
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+void
+Dataset::makeResident(const unsigned int imageNo) const
+{
+    cacheEntry entry;
+    if (!cache.load(imageKeys[imageNo], entry, true) ||
+        entry.channels.size() != cachedChNo) {
+        log_err("Unable to map image %d back from the cache", imageNo+1);
+        throw std::runtime_error("cacheEntryMissing");
+    }
+    for (unsigned int i = 0; i < cachedChNo; ++i) {
+        data[i][imageNo] = entry.channels[i];
+    }
+    residentImages.push_front(imageNo);
+    residentPos[imageNo] = residentImages.begin();
+    isResident[imageNo] = true;
+
+    while (residentImages.size() > maxResidentImages) {
+        const unsigned int victim = residentImages.back();
+        residentImages.pop_back();
+        isResident[victim] = false;
+        for (unsigned int i = 0; i < cachedChNo; ++i) {
+            data[i][victim] = ChannelPlane();
+        }
+    }
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+const Dataset::channelDescr Dataset::channelDescrs[] = {
+    { "GAUSSIAN_FILTERING", &Dataset::gaussianFiltering, CH_SRC_GREEN },
+    { "IMAGE_GRAY_CH", &Dataset::imageGrayCh, CH_SRC_GRAY },
+    { "IMAGE_CLAHE", &Dataset::imageCLAHE, CH_SRC_GRAY },
+    { "IMAGE_GREEN_CH", &Dataset::imageGreenCh, CH_SRC_GREEN },
+    { "IMAGE_RED_CH", &Dataset::imageRedCh, CH_SRC_BGR },
+    { "IMAGE_BLUE_CH", &Dataset::imageBlueCh, CH_SRC_BGR },
+    { "IMAGE_HUE_CH", &Dataset::imageHueCh, CH_SRC_HSV },
+    { "IMAGE_SATUR_CH", &Dataset::imageSaturCh, CH_SRC_HSV },
+    { "IMAGE_VALUE_CH", &Dataset::imageValueCh, CH_SRC_HSV },
+    { "IMAGE_L_CH", &Dataset::imageLCh, CH_SRC_LAB },
+    { "IMAGE_A_CH", &Dataset::imageACh, CH_SRC_LAB },
+    { "IMAGE_B_CH", &Dataset::imageBCh, CH_SRC_LAB },
+    { "LAPLACIAN_FILTERING", &Dataset::laplacianFiltering, CH_SRC_GREEN },
+    { "LBP", &Dataset::LBP, CH_SRC_GREEN },
+    { "MEDIAN_FILTERING", &Dataset::medianFiltering, CH_SRC_GRAY },
+    { "SOBEL_DRV_X", &Dataset::sobelDrvX, CH_SRC_GREEN },
+    { "SOBEL_DRV_Y", &Dataset::sobelDrvY, CH_SRC_GREEN },
+    { NULL, NULL, 0 }
+};
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("greenCh", cv::WINDOW_NORMAL);
+static void
+visualizeChannel(const char *name, const ChannelPlane &ch)
+{
+    EMat values;
+    ch.toEMat(values);
+    cv::Mat img;
+    cv::eigen2cv(values, img);
+    cv::namedWindow(name, cv::WINDOW_NORMAL);
     double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
+    cv::minMaxLoc(img, &min, &max);
     if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
+        img = (img-min)/(max-min);
     } else {
-        greenCh.setTo(cv::Scalar(0));
+        img.setTo(cv::Scalar(0));
     }
-    cv::imshow("greenCh", greenCh);
+    cv::imshow(name, img);
     cv::waitKey(0);
-#endif // VISUALIZE_IMG_DATA
-
-    return EXIT_SUCCESS;
 }
+#endif // VISUALIZE_IMG_DATA
 
-int
-Dataset::imageRedCh(const cv::Mat &src, EMat &dst, const void *opaque)
+void
+Dataset::computeChannelSources(const cv::Mat &img,
+                               const unsigned int sources,
+                               channelSources &dst)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
+    if (sources & CH_SRC_BGR) {
+        cv::split(img, dst.bgr);
+        dst.green = dst.bgr[1];
+    } else if (sources & CH_SRC_GREEN) {
+        cv::extractChannel(img, dst.green, 1);
+    }
+
+    if (sources & CH_SRC_GRAY) {
+        cv::cvtColor(img, dst.gray, CV_BGR2GRAY);
+    }
 
-    cv::split(src, colorCh);
+    if (sources & CH_SRC_HSV) {
+        cv::Mat hsv;
+        cv::cvtColor(img, hsv, cv::COLOR_BGR2HSV);
+        cv::split(hsv, dst.hsv);
+    }
 
-    cv::Mat redCh = colorCh[2];
+    if (sources & CH_SRC_LAB) {
+        cv::Mat lab;
+        cv::cvtColor(img, lab, cv::COLOR_BGR2Lab);
+        cv::split(lab, dst.lab);
+    }
+}
 
-    cv::Mat imgCenter = redCh(cv::Range(borderSize,
-                                        redCh.rows-borderSize+1),
-                              cv::Range(borderSize,
-                                        redCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    redCh -= mean[0];
-    redCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+void
+Dataset::computeMeanStd(const cv::Mat &src, double &mean, double &stdDev)
+{
+    /* Single pass over the plane: rows are summed in float by the SIMD
+       kernel, the row sums are accumulated in double */
+    double sum = 0;
+    double sumSq = 0;
+    for (int r = 0; r < src.rows; ++r) {
+        float rowSum;
+        float rowSumSq;
+        momentsF32(src.ptr< float >(r), src.cols, rowSum, rowSumSq);
+        sum += rowSum;
+        sumSq += rowSumSq;
+    }
+    const double n = (double)src.rows*src.cols;
+    mean = sum/n;
+    stdDev = sqrt(std::max(sumSq/n-mean*mean, 0.0));
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(redCh, dst);
+void
+Dataset::accumulateMoments(const cv::Mat &src, channelNorm &norm)
+{
+    for (int r = 0; r < src.rows; ++r) {
+        float rowSum;
+        float rowSumSq;
+        momentsF32(src.ptr< float >(r), src.cols, rowSum, rowSumSq);
+        norm.sum += rowSum;
+        norm.sumSq += rowSumSq;
+    }
+    norm.count += (double)src.rows*src.cols;
+}
 
-#ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("RED", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(redCh, &min, &max);
-    if (max-min > 1e-4) {
-        redCh = (redCh-min)/(max-min);
+void
+Dataset::normalizeChannel(const cv::Mat &src,
+                          const channelOpArgs &args,
+                          ChannelPlane &dst)
+{
+    double mean;
+    double std_dev;
+    if (args.norm == nullptr) {
+        computeMeanStd(src, mean, std_dev);
+    } else if (args.norm->collect) {
+        accumulateMoments(src(args.norm->core), *args.norm);
+        return;
     } else {
-        redCh.setTo(cv::Scalar(0));
+        mean = args.norm->mean;
+        std_dev = args.norm->stdDev;
+    }
+
+    /* Subtract and scale row by row while storing, the shared source plane
+       is left untouched */
+    const float scale = 1.0/(std_dev+
+                             10*std::numeric_limits< float >::epsilon());
+    dst = ChannelPlane(src.rows, src.cols,
+                       args.compact ? PLANE_FLOAT16 : PLANE_FLOAT32);
+    std::vector< float > row(src.cols);
+    for (int r = 0; r < src.rows; ++r) {
+        scaleShiftF32(src.ptr< float >(r), src.cols, scale,
+                      -(float)mean*scale, row.data());
+        dst.setRow(r, row.data());
     }
-    cv::imshow("RED", redCh);
-    cv::waitKey(0);
-#endif // VISUALIZE_IMG_DATA
-
-    return EXIT_SUCCESS;
 }
 
-int
-Dataset::imageBlueCh(const cv::Mat &src, EMat &dst, const void *opaque)
+void
+Dataset::normalizeCodes(const cv::Mat &codes,
+                        const float codeScale,
+                        const channelOpArgs &args,
+                        ChannelPlane &dst)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
+    /* Moments of the codes */
+    double mean;
+    double std_dev;
+    if (args.norm == nullptr) {
+        cv::Scalar codesMean;
+        cv::Scalar codesStdDev;
+        cv::meanStdDev(codes, codesMean, codesStdDev);
+        mean = codesMean[0];
+        std_dev = codesStdDev[0];
+    } else if (args.norm->collect) {
+        /* Tile normalizations hold the moments of the values */
+        cv::Mat values;
+        codes(args.norm->core).convertTo(values, CV_32FC1, 1.0/codeScale);
+        accumulateMoments(values, *args.norm);
+        return;
+    } else {
+        mean = args.norm->mean*codeScale;
+        std_dev = args.norm->stdDev*codeScale;
+    }
 
-    cv::split(src, colorCh);
+    /* value = (code/codeScale-mean)*scale, where mean and std_dev are those
+       of the values: fold it in a scale and an offset on the codes */
+    const float scale = 1.0/(std_dev/codeScale+
+                             10*std::numeric_limits< float >::epsilon());
+    const float codesScale = scale/codeScale;
+    const float codesOffset = -(float)mean*codesScale;
+    if (args.compact) {
+        dst = ChannelPlane(codes, codesScale, codesOffset);
+        return;
+    }
 
-    cv::Mat blueCh = colorCh[0];
+    dst = ChannelPlane(codes.rows, codes.cols, PLANE_FLOAT32);
+    std::vector< float > row(codes.cols);
+    for (int r = 0; r < codes.rows; ++r) {
+        expandU8(codes.ptr< unsigned char >(r), codes.cols, codesScale,
+                 codesOffset, row.data());
+        dst.setRow(r, row.data());
+    }
+}
 
-    cv::Mat imgCenter = blueCh(cv::Range(borderSize,
-                                         blueCh.rows-borderSize+1),
-                               cv::Range(borderSize,
-                                         blueCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    blueCh -= mean[0];
-    blueCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+void
+Dataset::normalizeQuantizedChannel(const cv::Mat &src,
+                                   const float codeScale,
+                                   const channelOpArgs &args,
+                                   ChannelPlane &dst)
+{
+    if (!args.compact) {
+        normalizeChannel(src, args, dst);
+        return;
+    }
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(blueCh, dst);
+    cv::Mat codes;
+    src.convertTo(codes, CV_8UC1, codeScale);
+    normalizeCodes(codes, codeScale, args, dst);
+}
+
+int
+Dataset::imageGrayCh(const channelSources &src, ChannelPlane &dst,
+                     const void *opaque)
+{
+    normalizeChannel(src.gray, *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("BLUE", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(blueCh, &min, &max);
-    if (max-min > 1e-4) {
-        blueCh = (blueCh-min)/(max-min);
-    } else {
-        blueCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("BLUE", blueCh);
-    cv::waitKey(0);
+    visualizeChannel("grayCh", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageHueCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageCLAHE(const channelSources &src, ChannelPlane &dst,
+                    const void *opaque)
 {
-    std::vector< cv::Mat> hsv_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat hsv_image;
-    cv::cvtColor(src, hsv_image, cv::COLOR_BGR2HSV);
-    cv::split(hsv_image, hsv_channels);
-
-    cv::Mat hueCh = hsv_channels[0];
-
-    cv::Mat imgCenter = hueCh(cv::Range(borderSize,
-                                        hueCh.rows-borderSize+1),
-                              cv::Range(borderSize,
-                                        hueCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    hueCh -= mean[0];
-    hueCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    cv::Mat tmp;
+    cv::Mat tmp2;
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(hueCh, dst);
+    /* Undo float conversion! */
+    src.gray.convertTo(tmp, CV_8UC1, 255);
+    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
+    clahe->setClipLimit(4);
+    clahe->apply(tmp, tmp2);
 
-#ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("HUE", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(hueCh, &min, &max);
-    if (max-min > 1e-4) {
-        hueCh = (hueCh-min)/(max-min);
+    if (((const channelOpArgs *)opaque)->compact) {
+        /* The CLAHE output is not normalized, its codes are exact */
+        dst = ChannelPlane(tmp2, 1.0/255, 0);
     } else {
-        hueCh.setTo(cv::Scalar(0));
+        cv::Mat gray;
+        tmp2.convertTo(gray, CV_32FC1, 1.0/255);
+        EMat eGray(gray.rows, gray.cols);
+        cv::cv2eigen(gray, eGray);
+        dst = ChannelPlane(eGray);
     }
-    cv::imshow("HUE", hueCh);
-    cv::waitKey(0);
+
+#ifdef VISUALIZE_IMG_DATA
+    visualizeChannel("CLAHE", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageLCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageGreenCh(const channelSources &src, ChannelPlane &dst,
+                      const void *opaque)
 {
-    std::vector< cv::Mat> lab_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat lab_image;
-    cv::cvtColor(src, lab_image, cv::COLOR_BGR2Lab);
-    cv::split(lab_image, lab_channels);
-
-    cv::Mat LCh = lab_channels[0];
-
-    cv::Mat imgCenter = LCh(cv::Range(borderSize,
-                                      LCh.rows-borderSize+1),
-                            cv::Range(borderSize,
-                                      LCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    LCh -= mean[0];
-    LCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(LCh, dst);
+    normalizeQuantizedChannel(src.green, 255, *(const channelOpArgs *)opaque,
+                              dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("L", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(LCh, &min, &max);
-    if (max-min > 1e-4) {
-        LCh = (LCh-min)/(max-min);
-    } else {
-        LCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("L", LCh);
-    cv::waitKey(0);
+    visualizeChannel("greenCh", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageACh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageRedCh(const channelSources &src, ChannelPlane &dst,
+                    const void *opaque)
 {
-    std::vector< cv::Mat> lab_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat lab_image;
-    cv::cvtColor(src, lab_image, cv::COLOR_BGR2Lab);
-    cv::split(lab_image, lab_channels);
-
-    cv::Mat ACh = lab_channels[0];
-
-    cv::Mat imgCenter = ACh(cv::Range(borderSize,
-                                      ACh.rows-borderSize+1),
-                            cv::Range(borderSize,
-                                      ACh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    ACh -= mean[0];
-    ACh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(ACh, dst);
+    normalizeQuantizedChannel(src.bgr[2], 255, *(const channelOpArgs *)opaque,
+                              dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("A", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(ACh, &min, &max);
-    if (max-min > 1e-4) {
-        ACh = (ACh-min)/(max-min);
-    } else {
-        ACh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("A", ACh);
-    cv::waitKey(0);
+    visualizeChannel("RED", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageBCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageBlueCh(const channelSources &src, ChannelPlane &dst,
+                     const void *opaque)
 {
-    std::vector< cv::Mat> lab_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat lab_image;
-    cv::cvtColor(src, lab_image, cv::COLOR_BGR2Lab);
-    cv::split(lab_image, lab_channels);
-
-    cv::Mat BCh = lab_channels[0];
-
-    cv::Mat imgCenter = BCh(cv::Range(borderSize,
-                                      BCh.rows-borderSize+1),
-                            cv::Range(borderSize,
-                                      BCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    BCh -= mean[0];
-    BCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(BCh, dst);
+    normalizeQuantizedChannel(src.bgr[0], 255, *(const channelOpArgs *)opaque,
+                              dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("B", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(BCh, &min, &max);
-    if (max-min > 1e-4) {
-        BCh = (BCh-min)/(max-min);
-    } else {
-        BCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("B", BCh);
-    cv::waitKey(0);
+    visualizeChannel("BLUE", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageSaturCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageHueCh(const channelSources &src, ChannelPlane &dst,
+                    const void *opaque)
 {
-    std::vector< cv::Mat> hsv_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat hsv_image;
-    cv::cvtColor(src, hsv_image, cv::COLOR_BGR2HSV);
-    cv::split(hsv_image, hsv_channels);
-
-    cv::Mat saturCh = hsv_channels[1];
-
-    cv::Mat imgCenter = saturCh(cv::Range(borderSize,
-                                          saturCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          saturCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    saturCh -= mean[0];
-    saturCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(saturCh, dst);
+    normalizeChannel(src.hsv[0], *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("SATUR", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(saturCh, &min, &max);
-    if (max-min > 1e-4) {
-        saturCh = (saturCh-min)/(max-min);
-    } else {
-        saturCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("SATUR", saturCh);
-    cv::waitKey(0);
+    visualizeChannel("HUE", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::imageValueCh(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageLCh(const channelSources &src, ChannelPlane &dst,
+                  const void *opaque)
 {
-    std::vector< cv::Mat> hsv_channels(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::Mat hsv_image;
-    cv::cvtColor(src, hsv_image, cv::COLOR_BGR2HSV);
-    cv::split(hsv_image, hsv_channels);
-
-    cv::Mat valueCh = hsv_channels[2];
-
-    cv::Mat imgCenter = valueCh(cv::Range(borderSize,
-                                          valueCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          valueCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    valueCh -= mean[0];
-    valueCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(valueCh, dst);
+    normalizeChannel(src.lab[0], *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("VALUE", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(valueCh, &min, &max);
-    if (max-min > 1e-4) {
-        valueCh = (valueCh-min)/(max-min);
-    } else {
-        valueCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("VALUE", valueCh);
-    cv::waitKey(0);
+    visualizeChannel("L", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
+/*
+ * Note: the A and B channels have always been computed on the L plane, and
+ * the classifiers trained so far rely on it. Keep it that way until the
+ * models are retrained.
+ */
 int
-Dataset::gaussianFiltering(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageACh(const channelSources &src, ChannelPlane &dst,
+                  const void *opaque)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::split(src, colorCh);
+    normalizeChannel(src.lab[0], *(const channelOpArgs *)opaque, dst);
 
-    cv::Mat greenCh = colorCh[1];
-    cv::GaussianBlur(greenCh, greenCh, cv::Size(0, 0), 1);
+#ifdef VISUALIZE_IMG_DATA
+    visualizeChannel("A", dst);
+#endif // VISUALIZE_IMG_DATA
 
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+int
+Dataset::imageBCh(const channelSources &src, ChannelPlane &dst,
+                  const void *opaque)
+{
+    normalizeChannel(src.lab[0], *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("Gaussian", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
-    if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
-    } else {
-        greenCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("Gaussian", greenCh);
-    cv::waitKey(0);
+    visualizeChannel("B", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::laplacianFiltering(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::imageSaturCh(const channelSources &src, ChannelPlane &dst,
+                      const void *opaque)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::split(src, colorCh);
+    normalizeChannel(src.hsv[1], *(const channelOpArgs *)opaque, dst);
 
-    cv::Mat greenCh = colorCh[1];
-    cv::Laplacian(greenCh, greenCh, CV_32FC1, 9);
+#ifdef VISUALIZE_IMG_DATA
+    visualizeChannel("SATUR", dst);
+#endif // VISUALIZE_IMG_DATA
 
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+int
+Dataset::imageValueCh(const channelSources &src, ChannelPlane &dst,
+                      const void *opaque)
+{
+    normalizeQuantizedChannel(src.hsv[2], 255, *(const channelOpArgs *)opaque,
+                              dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("Laplacian", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
-    if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
-    } else {
-        greenCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("Laplacian", greenCh);
-    cv::waitKey(0);
+    visualizeChannel("VALUE", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::LBP(const cv::Mat &src, EMat &dst, const void *opaque)
-{
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::split(src, colorCh);
-
-    cv::Mat greenCh = colorCh[1];
-    cv::Mat tmpDst = cv::Mat::zeros(greenCh.rows-2, greenCh.cols-2, CV_8UC1);
-	for(int i=1;i<greenCh.rows-1;i++) {
-		for(int j=1;j<greenCh.cols-1;j++) {
-			float center = greenCh.at<float>(i,j);
-			unsigned char code = 0;
-			code |= (greenCh.at<float>(i-1,j-1) > center) << 7;
-			code |= (greenCh.at<float>(i-1,j) > center) << 6;
-			code |= (greenCh.at<float>(i-1,j+1) > center) << 5;
-			code |= (greenCh.at<float>(i,j+1) > center) << 4;
-			code |= (greenCh.at<float>(i+1,j+1) > center) << 3;
-			code |= (greenCh.at<float>(i+1,j) > center) << 2;
-			code |= (greenCh.at<float>(i+1,j-1) > center) << 1;
-			code |= (greenCh.at<float>(i,j-1) > center) << 0;
-			tmpDst.at<unsigned char>(i-1,j-1) = code;
-		}
-	}
-    tmpDst.convertTo(greenCh, CV_32FC1);
-
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+Dataset::gaussianFiltering(const channelSources &src, ChannelPlane &dst,
+                           const void *opaque)
+{
+    cv::Mat filtered;
+    cv::GaussianBlur(src.green, filtered, cv::Size(0, 0), 1, 0,
+                     cv::BORDER_REFLECT);
+    normalizeChannel(filtered, *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("LBP", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
-    if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
-    } else {
-        greenCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("LBP", greenCh);
-    cv::waitKey(0);
+    visualizeChannel("Gaussian", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::medianFiltering(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::laplacianFiltering(const channelSources &src, ChannelPlane &dst,
+                            const void *opaque)
 {
-    cv::Mat gray;
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::cvtColor(src, gray, CV_BGR2GRAY);
-    cv::medianBlur(gray, gray, 3);
-    cv::Mat imgCenter = gray(cv::Range(borderSize, gray.rows-borderSize+1),
-                             cv::Range(borderSize, gray.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    gray -= mean[0];
-    gray /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
-
-    dst.resize(gray.rows, gray.cols);
-    cv::cv2eigen(gray, dst);
+    cv::Mat filtered;
+    cv::Laplacian(src.green, filtered, CV_32FC1, 9, 1, 0,
+                  cv::BORDER_REFLECT);
+    normalizeChannel(filtered, *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("medFilt", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(gray, &min, &max);
-    if (max-min > 1e-4) {
-        gray = (gray-min)/(max-min);
-    } else {
-        gray.setTo(cv::Scalar(0));
-    }
-    cv::imshow("medFilt", gray);
-    cv::waitKey(0);
+    visualizeChannel("Laplacian", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::sobelDrvX(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::LBP(const channelSources &src, ChannelPlane &dst,
+             const void *opaque)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
-
-    cv::split(src, colorCh);
+    /* Reflect a 1-pixel border so that codes can be computed on the whole
+       image */
+    cv::Mat greenCh;
+    cv::copyMakeBorder(src.green, greenCh, 1, 1, 1, 1, cv::BORDER_REFLECT);
+
+    cv::Mat codes(src.green.rows, src.green.cols, CV_8UC1);
+    for (int i = 1; i < greenCh.rows-1; ++i) {
+        lbpRow(greenCh.ptr< float >(i-1),
+               greenCh.ptr< float >(i),
+               greenCh.ptr< float >(i+1),
+               src.green.cols,
+               codes.ptr< unsigned char >(i-1));
+    }
+    /* The codes are exact 8-bit values: normalize them straight away */
+    normalizeCodes(codes, 1, *(const channelOpArgs *)opaque, dst);
 
-    cv::Mat greenCh = colorCh[1];
-    cv::Sobel(greenCh, greenCh, CV_32FC1, 1, 0, 5);
+#ifdef VISUALIZE_IMG_DATA
+    visualizeChannel("LBP", dst);
+#endif // VISUALIZE_IMG_DATA
 
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+int
+Dataset::medianFiltering(const channelSources &src, ChannelPlane &dst,
+                         const void *opaque)
+{
+    cv::Mat filtered;
+    cv::medianBlur(src.gray, filtered, 3);
+    normalizeChannel(filtered, *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("sobelDrvX", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
-    if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
-    } else {
-        greenCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("sobelDrvX", greenCh);
-    cv::waitKey(0);
+    visualizeChannel("medFilt", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
 }
 
 int
-Dataset::sobelDrvY(const cv::Mat &src, EMat &dst, const void *opaque)
+Dataset::sobelDrvX(const channelSources &src, ChannelPlane &dst,
+                   const void *opaque)
 {
-    std::vector< cv::Mat> colorCh(3);
-    const unsigned int borderSize = *((unsigned int *)opaque);
+    cv::Mat filtered;
+    cv::Sobel(src.green, filtered, CV_32FC1, 1, 0, 5, 1, 0,
+              cv::BORDER_REFLECT);
+    normalizeChannel(filtered, *(const channelOpArgs *)opaque, dst);
 
-    cv::split(src, colorCh);
-
-    cv::Mat greenCh = colorCh[1];
-    cv::Sobel(greenCh, greenCh, CV_32FC1, 0, 1, 5);
+#ifdef VISUALIZE_IMG_DATA
+    visualizeChannel("sobelDrvX", dst);
+#endif // VISUALIZE_IMG_DATA
 
-    cv::Mat imgCenter = greenCh(cv::Range(borderSize,
-                                          greenCh.rows-borderSize+1),
-                                cv::Range(borderSize,
-                                          greenCh.cols-borderSize+1));
-    cv::Scalar mean;
-    cv::Scalar std_dev;
-    cv::meanStdDev(imgCenter, mean, std_dev);
-    greenCh -= mean[0];
-    greenCh /= (std_dev[0]+ 10*std::numeric_limits< float >::epsilon());
+    return EXIT_SUCCESS;
+}
 
-    dst.resize(src.rows, src.cols);
-    cv::cv2eigen(greenCh, dst);
+int
+Dataset::sobelDrvY(const channelSources &src, ChannelPlane &dst,
+                   const void *opaque)
+{
+    cv::Mat filtered;
+    cv::Sobel(src.green, filtered, CV_32FC1, 0, 1, 5, 1, 0,
+              cv::BORDER_REFLECT);
+    normalizeChannel(filtered, *(const channelOpArgs *)opaque, dst);
 
 #ifdef VISUALIZE_IMG_DATA
-    cv::namedWindow("ImgColor", cv::WINDOW_NORMAL);
-    cv::imshow("ImgColor", src);
-    cv::namedWindow("sobelDrvX", cv::WINDOW_NORMAL);
-    double min, max;
-    cv::minMaxLoc(greenCh, &min, &max);
-    if (max-min > 1e-4) {
-        greenCh = (greenCh-min)/(max-min);
-    } else {
-        greenCh.setTo(cv::Scalar(0));
-    }
-    cv::imshow("sobelDrvX", greenCh);
-    cv::waitKey(0);
+    visualizeChannel("sobelDrvY", dst);
 #endif // VISUALIZE_IMG_DATA
 
     return EXIT_SUCCESS;
@@ -2125,10 +2855,6 @@ int
 Dataset::addMask(const unsigned int imageID,
                  cv::Mat &src)
 {
-    cv::copyMakeBorder(src, src,
-                       borderSize, borderSize, borderSize, borderSize,
-                       cv::BORDER_CONSTANT, MASK_EXCLUDED);
-
     cv::Mat dst = src;
 
 #ifdef VISUALIZE_IMG_DATA
@@ -2139,9 +2865,15 @@ Dataset::addMask(const unsigned int imageID,
     cv::waitKey(0);
 #endif // VISUALIZE_IMG_DATA
 
-    EMat eDst(dst.rows, dst.cols);
-    cv::cv2eigen(dst, eDst);
-    masks[imageID] = eDst;
+    EByteMat eDst(dst.rows, dst.cols);
+    for (int r = 0; r < dst.rows; ++r) {
+        const float *dstRow = dst.ptr< float >(r);
+        for (int c = 0; c < dst.cols; ++c) {
+            eDst(r, c) = dstRow[c] == MASK_INCLUDED ?
+                MASK_INCLUDED : MASK_EXCLUDED;
+        }
+    }
+    masks[imageID] = std::make_shared< EByteMat >(std::move(eDst));
 
     return EXIT_SUCCESS;
 }
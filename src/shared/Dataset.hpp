@@ -24,6 +24,7 @@
 #include <vector>
 #include <iomanip>
 #include <algorithm>
+#include <list>
 
 #pragma GCC diagnostic ignored "-Wsign-conversion"
 #pragma GCC diagnostic ignored "-Wcast-qual"
@@ -34,11 +35,10 @@
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
-extern "C" {
-#include <omp.h>
-}
-
+#include "ChannelCache.hpp"
+#include "ChannelPlane.hpp"
 #include "DataTypes.hpp"
+#include "ImageBuffer.hpp"
 #include "logging.hpp"
 #include "utils.hpp"
 #include "Parameters.hpp"
@@ -52,6 +52,10 @@ const int IGN_GT_CLASS = 0;
 const int MASK_EXCLUDED = 0;
 const int MASK_INCLUDED = 255;
 
+/* Number of 8-bit gt values, used as the lookup-table entry of the gt
+   values that are not 8-bit integers */
+const int GT_LUT_OTHER = 256;
+
 /* Threshold for the initial point of the L histogram to be detected */
 const double L_THRESHOLD_INIT = 0.02;
 /* Threshold that has to be surpassed by the point three positions after to
@@ -66,7 +70,75 @@ const int M_BLUR_SIZE = 5;
 /* Weight given to images fed back from users */
 const int FEEDBACK_SAMPLE_WEIGHT = 10;
 
+/* Margin, in pixels of the rescaled image, covering the neighbourhood read
+   by the channel operations (used when computing the channels on tiles) */
+const unsigned int TILE_CHANNELS_HALO = 8;
+
+/* Intermediate images that can be shared among the channel operations */
+const unsigned int CH_SRC_BGR = 1 << 0;
+const unsigned int CH_SRC_GREEN = 1 << 1;
+const unsigned int CH_SRC_GRAY = 1 << 2;
+const unsigned int CH_SRC_HSV = 1 << 3;
+const unsigned int CH_SRC_LAB = 1 << 4;
+
+/**
+ * struct channelSources - Intermediate images computed once per input image
+ *                         and shared by all the channel operations
+ *
+ * @bgr  : split blue, green and red planes
+ * @green: green plane (used by the filtering operations)
+ * @gray : grayscale version of the image
+ * @hsv  : split hue, saturation and value planes
+ * @lab  : split CIE L, a and b planes
+ *
+ * Only the intermediates requested by at least one of the active channel
+ * operations are computed, the other ones are left empty.
+ */
+typedef struct channelSources {
+    std::vector< cv::Mat > bgr;
+    cv::Mat green;
+    cv::Mat gray;
+    std::vector< cv::Mat > hsv;
+    std::vector< cv::Mat > lab;
+} channelSources;
+
+/**
+ * struct channelNorm - Normalization of a channel computed over the tiles of
+ *                      an image rather than over a single plane
+ *
+ * @collect: accumulate the moments of the planes instead of normalizing them
+ * @core   : region of the planes whose moments are accumulated
+ * @sum    : accumulated sum of the values
+ * @sumSq  : accumulated sum of the squared values
+ * @count  : number of accumulated values
+ * @mean   : mean removed when normalizing
+ * @stdDev : standard deviation used to scale when normalizing
+ */
+typedef struct channelNorm {
+    bool collect;
+    cv::Rect core;
+    double sum;
+    double sumSq;
+    double count;
+    double mean;
+    double stdDev;
+} channelNorm;
+
+/**
+ * struct channelOpArgs - Arguments passed to the channel operations
+ *
+ * @compact: store the channel as 8-bit codes or half-precision values
+ * @norm   : normalization shared among tiles (nullptr to normalize the
+ *           plane on its own mean and standard deviation)
+ */
+typedef struct channelOpArgs {
+    bool compact;
+    channelNorm *norm;
+} channelOpArgs;
+
 class BoostedClassifier;
+class CompiledModel;
+class ImageReader;
 
 /**
  * class Dataset - Represent a dataset with all associated images and paths
@@ -75,6 +147,20 @@ class BoostedClassifier;
  * @dataChNo          : number of data channels
  * @imageOps          : set of operations performed on the loaded images (each
  *                      operation will lead to an additional channel)
+ * @imageOpsSources   : intermediate images required by the operations
+ * @compactChannels   : store the channels as 8-bit codes or half-precision
+ *                      values instead of float ones
+ * @cache             : on-disk cache of the data computed from each image
+ * @cacheRecipe       : hash of the parameters affecting the cached data
+ * @maxResidentImages : maximum number of images whose channels are kept in
+ *                      memory (0 to keep all of them)
+ * @cachedChNo        : number of channels (the leading ones) that are
+ *                      mapped back from the cache when needed (score
+ *                      channels are always kept in memory)
+ * @imageKeys         : cache keys of the images
+ * @residentImages    : resident images, most recently used first
+ * @residentPos       : position of each resident image in residentImages
+ * @isResident        : flag marking the images whose channels are in memory
  * @imagesNo          : number of loaded images
  * @imageNames        : names of the loaded images
  * @feedbackImagesFlag: flag marking images that have been fixed by a human
@@ -83,9 +169,11 @@ class BoostedClassifier;
  *                      each image coordinate by this value)
  * @originalSizes     : sizes of the input images
  * @sampleSize        : size of a sampled patch
- * @borderSize        : size of the replicated border around the image
- * @ePoints           : mask marking the spots where the classifier has to be
- *                      evaluated
+ * @borderSize        : size of the reflected border added around the
+ *                      channels for full-image evaluation (channels, masks
+ *                      and gts are stored without border)
+ * @ePoints           : runs of points marking the spots where the classifier
+ *                      has to be evaluated
  * @fastClassifier    : enable fast classification (only candidate points are
  *                      tested)
  * @RBCdetection      : in fast classification mode, enlarge candidate points to
@@ -104,8 +192,28 @@ class BoostedClassifier;
  * @gtPairValues      : gt pairs numeric values (each pair will require a
  *                      boosted classifier)
  * @gtPairsNo         : number of ground-truth pairs
- * @nRotations        : number of rotated versions of the training samples that
- *                      have to be considered
+ * @nRotations        : number of rotated versions of each image stored in the
+ *                      dataset (1 when rotations are generated on the fly)
+ * @posSampleCounts   : per gt pair and image, row prefix counts of the
+ *                      positive samples available
+ * @negSampleCounts   : per gt pair and image, row prefix counts of the
+ *                      negative samples available
+ * @transformsNo      : number of geometric transforms that can be applied on
+ *                      the fly to the samples (1 for the identity only)
+ * @transformOffsets  : for each transform, offsets of the sample pixels with
+ *                      respect to the sample position
+ * @tileSize          : side of the tiles on which the images are classified
+ *                      (0 to classify each image as a whole)
+ * @maskPaths         : paths of the masks, read when classifying by tiles
+ *                      or streaming the images
+ * @imagesInFlight    : number of streamed images processed at the same time
+ *                      (0 to load all the images upfront)
+ * @streamReader      : reader decoding the streamed images ahead of their
+ *                      classification
+ * @stageClassifiers  : AutoContext classifiers applied to the streamed
+ *                      images as they are loaded
+ * @stagesModel       : AutoContext classifiers compiled for full-image
+ *                      classification
  */
 class Dataset {
 public:
@@ -154,11 +262,11 @@ public:
      * @pairNo : image pair to which the ground-truth belongs to
      * @imageNo: number of the image for which to return the ground-truth
      *
-     * Return: reference to the specified gt if available, reference to an
-     *     empty EMat otherwise
+     * Return: reference to the specified gt labels if available, reference
+     *     to an empty plane otherwise
      */
-    const EMat& getGt(const int pairNo,
-                      const unsigned int imageNo) const;
+    const ELabelMat& getGt(const int pairNo,
+                           const unsigned int imageNo) const;
 
     /**
      * getGtNegativePairValue() - Get the value of the negative class for a
@@ -212,9 +320,9 @@ public:
      * @imageNo: number of the image for which to return the ground-truth
      *
      * Return: reference to the specified gt if available, reference to an
-     *     empty EMat otherwise
+     *     empty plane otherwise
      */
-    const EMat& getOriginalGt(const unsigned int imageNo) const;
+    const EByteMat& getOriginalGt(const unsigned int imageNo) const;
 
     /**
      * getSamplePositions() - Get a set of sampling positions from the
@@ -261,6 +369,9 @@ public:
      *
      * Samples are taken from the given upper-left corner plus the offsets.
      * Samples are row-major (that is, each sample is taken row-by-row).
+     * Pixels falling outside the image are read from its reflection.
+     * Samples with a transform are gathered rotated/flipped around their
+     * position, from the single stored image.
      */
     void getSampleMatrix(const sampleSet &samplePositions,
                          const std::vector< unsigned int > &samplesIdx,
@@ -270,6 +381,31 @@ public:
                          const unsigned int size,
                          EMat &samples) const;
 
+    /**
+     * getSampleResponses() - Compute the response of a filter on a specified
+     *                        set of samples, without materialising them
+     *
+     * @samplePositions: list of available sampling positions
+     * @samplesIdx     : indexes of the subset of patches to evaluate
+     * @chNo           : channel from which to sample from
+     * @rowOffset      : row offset to impose while sampling
+     * @colOffset      : col offset to impose while sampling
+     * @size           : size of the samples (and of the filter)
+     * @filter         : filter, shaped as a row-major size*size vector
+     * @responses      : resulting responses, one per sample
+     *
+     * The responses are those of getSampleMatrix()*filter: the rows of
+     * each patch are multiplied in place in the stored plane.
+     */
+    void getSampleResponses(const sampleSet &samplePositions,
+                            const std::vector< unsigned int > &samplesIdx,
+                            const unsigned int chNo,
+                            const unsigned int rowOffset,
+                            const unsigned int colOffset,
+                            const unsigned int size,
+                            const EMat &filter,
+                            EVec &responses) const;
+
     /**
      * shrinkSamplePositions() - Drop samples from a sample set until the
      *               desired size is reached
@@ -289,54 +425,125 @@ public:
 
     /**
      * getChsForImage() - Get the channels corresponding to a specified
-     *            image in OpenCV format and enlarged by borderSize
+     *            image as float buffers enlarged by borderSize
+     *            (the border is a reflection of the image)
      *
      * @n  : image number
-     * @chs: resulting vector containing the desired data in OpenCV format
+     * @chs: resulting vector containing the desired data
      */
     void getChsForImage(const unsigned int n,
-                        std::vector< cv::Mat > &chs) const;
+                        std::vector< ImageBuffer > &chs) const;
 
+#ifndef MOVABLE_TRAIN
     /**
-     * getData() - Get a reference to the data of a specific image-channel
-     *         pair
+     * classifyImageTiled() - Classify an image tile by tile, without ever
+     *                        holding its channels as a whole
+     *
+     * @n                 : image number
+     * @boostedClassifiers: classifiers whose results are the additional
+     *                      channels of the final classifier (empty when
+     *                      AutoContext is not used)
+     * @finalClassifier   : classifier producing the result
+     * @result            : resulting score map, of the size of the image
+     *                      (float plane mapped on a scratch file)
+     *
+     * The image and its mask are read from disk here. Each tile is
+     * computed on its own together with a halo covering the reach of the
+     * classifiers and of the channel operations, so that the stitched
+     * result matches the one of getChsForImage() and classifyFullImage().
+     * The channels are normalized on the statistics of the whole image,
+     * gathered in a first pass over the tiles. Tiles outside the mask are
+     * not computed and score 0.
+     *
+     * The channels, scores and masks of the classifiers are bounded by the
+     * tile size, and the scores are written out tile by tile. Only the
+     * decoded 8-bit image and the mask (3 and 1 bytes per pixel) stay
+     * image-sized in memory.
      *
-     * @channelNo: number of the desired channel
-     * @imageNo  : number of the desired image
+     * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
+     */
+    int classifyImageTiled(const unsigned int n,
+                           const std::vector< BoostedClassifier * >
+                           &boostedClassifiers,
+                           const BoostedClassifier &finalClassifier,
+                           ChannelPlane &result);
+
+    /**
+     * isTiled() - Check whether the images are classified by tiles
      *
-     * Return: reference to the specified data if available, reference to an
-     *     empty EMat otherwise
+     * Return: true if the images are classified by tiles, false otherwise
      */
-    const EMat& getData(const unsigned int channelNo,
-                        const unsigned int imageNo) const;
+    bool isTiled() const;
 
     /**
-     * getDataChNo() - Return the number of data channels available
+     * loadImage() - Load a streamed image, computing its channels (along
+     *               with the ones of the AutoContext classifiers, if any)
      *
-     * Return: number of available data channels
+     * @n: image number
+     *
+     * The images are taken from the reader decoding them ahead, hence
+     * they have to be loaded in (roughly) increasing order. Tiled images
+     * are read while being classified, nothing is loaded for them here.
+     *
+     * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
      */
-    unsigned int getDataChNo() const;
+    int loadImage(const unsigned int n);
+
+    /**
+     * releaseImage() - Release the channels, the mask and the candidate
+     *                  points of a streamed image
+     *
+     * @n: image number
+     */
+    void releaseImage(const unsigned int n);
+
+    /**
+     * isStreamed() - Check whether the images are loaded one at a time,
+     *                when classified, rather than all together upfront
+     *
+     * Return: true if the images are streamed, false otherwise
+     */
+    bool isStreamed() const;
+
+    /**
+     * getImagesInFlight() - Get the number of streamed images processed
+     *                       at the same time
+     *
+     * Return: number of images processed at the same time
+     */
+    unsigned int getImagesInFlight() const;
+#endif // !MOVABLE_TRAIN
 
     /**
-     * getDataVector() - Get a reference to the specific data channel
-     *           vector
+     * getData() - Get the data of a specific image-channel pair
      *
      * @channelNo: number of the desired channel
+     * @imageNo  : number of the desired image
+     *
+     * The returned plane shares its memory with the dataset, and stays valid
+     * even if the image is evicted afterwards.
+     *
+     * Return: specified data if available, an empty plane otherwise
+     */
+    ChannelPlane getData(const unsigned int channelNo,
+                         const unsigned int imageNo) const;
+
+    /**
+     * getDataChNo() - Return the number of data channels available
      *
-     * Return: reference to the desired channel if available, reference to
-     *     an empty one otherwise
+     * Return: number of available data channels
      */
-    const dataVector& getDataVector(const unsigned int channelNo) const;
+    unsigned int getDataChNo() const;
 
     /**
-     * getEPoints() - Return the desired set of candidate points
+     * getEPoints() - Return the runs of candidate points of an image
      *
      * @imageNo: number of the image whose set of candidates is requested
      *
      * Return: reference to the desired set if available, reference to
      *     an empty set otherwise
      */
-    const sampleSet& getEPoints(const unsigned int imageNo) const;
+    const runSet& getEPoints(const unsigned int imageNo) const;
 
     /**
      * getImageName() - Return the filename of an input image
@@ -371,9 +578,9 @@ public:
      * @imageNo: number of the image whose mask is requested
      *
      * Return: reference to the desired mask if available, reference to
-     *     an empty EMat otherwise
+     *     an empty plane otherwise
      */
-    const EMat& getMask(const unsigned int imageNo) const;
+    const EByteMat& getMask(const unsigned int imageNo) const;
 
     /**
      * getOriginalImgSize() - Get the size of the input image before
@@ -401,21 +608,47 @@ public:
      * @colorImg: RGB version of the input image
      * @mask    : mask that has to be applied on the image
      *
-     * @note: the system computes the mask and pushes it in the ePoints data
-     *        vector at the location corresponding to that of the image that
-     *        originated it
+     * @note: the system computes the mask and pushes its runs in the ePoints
+     *        data vector at the location corresponding to that of the image
+     *        that originated it
      */
     void computeCandidatePointsMask(const unsigned int imageID,
                                     const cv::Mat& colorImg,
                                     const cv::Mat& mask);
 
 private:
-    typedef int (*ImageOps)(const cv::Mat &src, EMat &dst,
+    typedef int (*ImageOps)(const channelSources &src, ChannelPlane &dst,
                             const void *opaque);
 
-    dataChannels data;
+    /**
+     * struct channelDescr - Description of an available channel
+     *
+     * @name   : name used to request the channel in the parameters
+     * @op     : operation computing the channel
+     * @sources: intermediate images required by the operation
+     */
+    typedef struct channelDescr {
+        const char *name;
+        ImageOps op;
+        unsigned int sources;
+    } channelDescr;
+
+    /* Available channels, in the order in which they are stacked */
+    static const channelDescr channelDescrs[];
+
+    mutable dataChannels data;
     unsigned int dataChNo;
     std::vector< ImageOps > imageOps;
+    unsigned int imageOpsSources;
+    bool compactChannels;
+    ChannelCache cache;
+    uint64_t cacheRecipe;
+    unsigned int maxResidentImages;
+    unsigned int cachedChNo;
+    std::vector< uint64_t > imageKeys;
+    mutable std::list< unsigned int > residentImages;
+    mutable std::vector< std::list< unsigned int >::iterator > residentPos;
+    mutable std::vector< bool > isResident;
     unsigned int imagesNo;
     std::vector< std::string > imageNames;
     std::vector< std::string > imagePaths;
@@ -424,7 +657,7 @@ private:
     bool fastClassifier;
     bool RBCdetection;
     bool useAutoContext;
-    std::vector< sampleSet > ePoints;
+    std::vector< sharedRunSet > ePoints;
     double houghMinDist;
     double houghHThresh;
     double houghLThresh;
@@ -437,16 +670,44 @@ private:
     unsigned int sampleSize;
     unsigned int borderSize;
 
+    /**
+     * struct sampleOffsets - Offsets of the pixels of a transformed sample
+     *
+     * @rows: row offsets, for each pixel of the sample (row-major)
+     * @cols: column offsets, for each pixel of the sample (row-major)
+     */
+    typedef struct sampleOffsets {
+        std::vector< int > rows;
+        std::vector< int > cols;
+    } sampleOffsets;
+
+    unsigned int transformsNo;
+    std::vector< sampleOffsets > transformOffsets;
+
     maskVector masks;
 
 #ifdef MOVABLE_TRAIN
     gtPairs gts;
-    gtVector originalGts;
+    std::vector< sharedByteMat > originalGts;
     std::vector< int > gtValues;
     std::vector< std::pair< int, int > > gtPairValues;
     unsigned int gtPairsNo;
     unsigned int nRotations;
 
+    /* Entry r holds the number of samples found in rows [0, r) */
+    typedef std::vector< unsigned int > rowPrefixCounts;
+    std::vector< std::vector< rowPrefixCounts > > posSampleCounts;
+    std::vector< std::vector< rowPrefixCounts > > negSampleCounts;
+#else // !MOVABLE_TRAIN
+    unsigned int tileSize;
+    std::vector< std::string > maskPaths;
+    unsigned int imagesInFlight;
+    std::shared_ptr< ImageReader > streamReader;
+    std::vector< BoostedClassifier * > stageClassifiers;
+    std::shared_ptr< const CompiledModel > stagesModel;
+#endif // MOVABLE_TRAIN
+
+#ifdef MOVABLE_TRAIN
     /**
      * addGt() - Preprocess the ground-truth image passed as parameter, and
      *       then push it into the dataset, exploding it on the
@@ -463,58 +724,45 @@ private:
      * addImage() - Add an image along with its ground-truth and mask,
      *      computing the additional channels from the image itself
      *
-     * @imageID   : image ID (corresponding to its position)
-     * @imgPath : path of the input image
-     * @maskPath: path of the input mask
-     * @gtPath  : path of the input ground-truth
+     * @imageID: image ID (corresponding to its position)
+     * @srcImg : decoded input image
+     * @srcMask: decoded input mask
+     * @srcGt  : decoded input ground-truth
      *
-     * Return: -EXIT_FAILURE if one of more of the input paths are invalid
-     *     or an image has invalid size, EXIT_SUCCESS otherwise
+     * Return: -EXIT_FAILURE if an image has invalid size, EXIT_SUCCESS
+     *         otherwise
      */
     int addImage(const unsigned int imageID,
-                 const std::string &imgPath,
-                 const std::string &maskPath,
-                 const std::string &gtPath);
+                 const cv::Mat &srcImg,
+                 const cv::Mat &srcMask,
+                 const cv::Mat &srcGt);
 
     /**
-     * addaddRotatedImage() - Add the rotated version of an image along with its
-     *                        (rotated) ground-truth and mask, computing the
-     *                        additional channels from the image itself
+     * addRotatedImage() - Add the rotated version of an image along with its
+     *                     (rotated) ground-truth and mask, computing the
+     *                     additional channels from the image itself
      *
-     * @imageID : image ID (corresponding to its position)
-     * @imgPath : path of the input image
-     * @maskPath: path of the input mask
-     * @gtPath  : path of the input ground-truth
+     * @imageID: image ID (corresponding to its position)
+     * @rot    : rotation angle (degrees)
+     * @srcImg : decoded input image
+     * @srcMask: decoded input mask
+     * @srcGt  : decoded input ground-truth
      *
-     * Return: -EXIT_FAILURE if one of more of the input paths are invalid
-     *         or an image has invalid size, EXIT_SUCCESS otherwise
+     * Return: -EXIT_FAILURE if an image has invalid size, EXIT_SUCCESS
+     *         otherwise
      */
-
     int addRotatedImage(const unsigned int imageID,
                         const double rot,
-                        const std::string &imgPath,
-                        const std::string &maskPath,
-                        const std::string &gtPath);
-
-    /*
-     * collectAllSamplePositions() - Collect all the possible samples of the
-     *               given class from the specified gt
-     *               vector
-     *
-     * @gt           : vector of gt images used in sampling
-     * @sampleClass      : identifier of the class to sample
-     * @availableSamples : returned vector of samples, where samples are
-     *             split over images
-     * @samplesPerImageNo: number of samples of the desired class for each
-     *             separate image
-     *
-     * Return: total number of sampled points
+                        const cv::Mat &srcImg,
+                        const cv::Mat &srcMask,
+                        const cv::Mat &srcGt);
+
+    /**
+     * countSamplePositions() - Compute, for each gt pair and image, the
+     *                          per-row prefix counts of the positive and
+     *                          negative positions available for sampling
      */
-    unsigned int
-    collectAllSamplePositions(const gtVector &gt,
-                              const int sampleClass,
-                              std::vector< sampleSet > &availableSamples,
-                              std::vector< int > &samplesPerImageNo) const;
+    void countSamplePositions();
 
     /**
      * createGtPairs() - Create a set of gt pairs, starting from a list of
@@ -526,16 +774,17 @@ private:
 
     /**
      * getAvailableSamples() - Extract a set of samples of the desired size
-     *             from the given gt vector
+     *             from the given gt pair, without materialising the
+     *             list of all the available positions
      *
-     * @gt         : vector of gt images used in sampling
+     * @gtPair         : gt pair used in sampling
      * @sampleClass    : identifier of the class to sample
      * @samplesNo      : requested number of samples
      * @samplePositions: output sampled positions
      *
      * Return: total number of sampled points
      */
-    int getAvailableSamples(const gtVector &gt,
+    int getAvailableSamples(const unsigned int gtPair,
                             const int sampleClass,
                             const unsigned int samplesNo,
                             sampleSet &samplePositions) const;
@@ -560,17 +809,16 @@ private:
      * addImage() - Add an image along with its mask, computing the
      *      additional channels from the image itself
      *
-     * @imageID : image ID (corresponding to its position)
-     * @imgPath : path of the input image
-     * @maskPath: path of the input mask
+     * @imageID: image ID (corresponding to its position)
+     * @srcImg : decoded input image
+     * @srcMask: decoded input mask
      *
-     * Return: -EXIT_FAILURE if one of more of the input paths are invalid
-     *     or an image has invalid size, EXIT_SUCCESS otherwise
+     * Return: -EXIT_FAILURE if an image has invalid size, EXIT_SUCCESS
+     *         otherwise
      */
-
     int addImage(const unsigned int imageID,
-                 const std::string &imgPath,
-                 const std::string &maskPath);
+                 const cv::Mat &srcImg,
+                 const cv::Mat &srcMask);
 
     /**
      * loadPaths() - Load a list of paths for imgs/masks
@@ -584,20 +832,356 @@ private:
     int loadPaths(const Parameters &params,
                   std::vector< std::string > &img_paths,
                   std::vector< std::string > &mask_paths);
+
+    /**
+     * classifyStages() - Compute the channels given by the AutoContext
+     *                    classifiers on an image
+     *
+     * @n                 : image number
+     * @boostedClassifiers: AutoContext classifiers
+     * @baseChNo          : number of channels the classifiers are applied
+     *                      on, the results are stored right after them
+     */
+    void classifyStages(const unsigned int n,
+                        const std::vector< BoostedClassifier * >
+                        &boostedClassifiers,
+                        const unsigned int baseChNo);
+
+    /**
+     * loadTiledImage() - Decode an image and its mask, storing the mask and
+     *                    returning the image rescaled as in addImage()
+     *
+     * @imageID: image ID (corresponding to its position)
+     * @img    : rescaled image, still holding 8-bit values
+     *
+     * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
+     */
+    int loadTiledImage(const unsigned int imageID, cv::Mat &img);
+
+    /**
+     * computeTileChannels() - Compute the channels on a region of an image
+     *
+     * @img   : rescaled image, as returned by loadTiledImage()
+     * @region: region of the image on which the channels are computed
+     * @norms : normalization of each channel, either collecting the moments
+     *          of the planes or applying the ones collected
+     * @planes: resulting planes, of the size of the region (left empty
+     *          while collecting the moments)
+     *
+     * Return: -EXIT_FAILURE on error, EXIT_SUCCESS otherwise
+     */
+    int computeTileChannels(const cv::Mat &img,
+                            const cv::Rect &region,
+                            std::vector< channelNorm > &norms,
+                            dataVector &planes) const;
+
+    /**
+     * getChsForWindow() - Get the channels of a window of an image as float
+     *                     buffers enlarged by a border (the border is a
+     *                     reflection of the image where it falls outside)
+     *
+     * @planes    : planes holding the channels on a region of the image
+     * @planesRect: region of the image covered by the planes
+     * @window    : window of the image whose channels are required
+     * @border    : size of the border added around the window
+     * @imageSize : size of the whole image
+     * @chs       : vector to which the resulting buffers are appended
+     *
+     * The planes have to cover the window enlarged by the border, once
+     * the pixels outside the image are reflected back in it.
+     */
+    static void getChsForWindow(const dataVector &planes,
+                                const cv::Rect &planesRect,
+                                const cv::Rect &window,
+                                const unsigned int border,
+                                const cv::Size &imageSize,
+                                std::vector< ImageBuffer > &chs);
 #endif // MOVABLE_TRAIN
 
+    /**
+     * buildTransformOffsets() - Precompute the offset tables of the
+     *                           transforms applied on the fly to the samples
+     *
+     * @rotationsNo: number of rotations (evenly spaced over 360 degrees)
+     * @flips      : add the mirrored version of each rotation
+     *
+     * Transform t rotates the sample by t*360/rotationsNo degrees around its
+     * position, transforms from rotationsNo onwards mirror it first.
+     */
+    void buildTransformOffsets(const unsigned int rotationsNo,
+                               const bool flips);
+
+    /**
+     * struct imageVersions - Versions of an input image to add to the
+     *                        dataset
+     *
+     * @imageNo  : number of the plain image
+     * @imageIDs : image ID of each version
+     * @angles   : rotation angle of each version (degrees)
+     * @cacheKeys: cache key of each version
+     * @done     : whether each version has already been loaded
+     * @useCache : whether the versions are read from/written to the cache
+     */
+    typedef struct imageVersions {
+        unsigned int imageNo;
+        std::vector< unsigned int > imageIDs;
+        std::vector< double > angles;
+        std::vector< uint64_t > cacheKeys;
+        std::vector< bool > done;
+        bool useCache;
+    } imageVersions;
+
+    /**
+     * loadImageFiles() - Load all the input images (along with their
+     *                    rotated versions), decoding them in a pool of
+     *                    reader threads ahead of the channels computation
+     *
+     * @paths      : for each image, paths of the image, of its mask and
+     *               (when training) of its ground-truth
+     * @rotationsNo: number of versions of each image (the plain one
+     *               included)
+     * @readersNo  : number of reader threads
+     * @queueDepth : maximum number of images decoded ahead of their use
+     *
+     * Images whose versions can all be loaded from the cache are never
+     * decoded. Throws on error.
+     */
+    void loadImageFiles(const std::vector< std::vector< std::string > > &paths,
+                        const unsigned int rotationsNo,
+                        const unsigned int readersNo,
+                        const unsigned int queueDepth);
+
+    /**
+     * loadCachedImageFiles() - Set up the versions of an input image, and
+     *                          load from the cache the ones it holds
+     *
+     * @imageNo     : number of the plain image
+     * @baseImagesNo: number of plain images in the dataset
+     * @rotationsNo : number of versions (the plain one included)
+     * @paths       : paths of the image, of its mask and (when training) of
+     *                its ground-truth
+     * @versions    : output versions of the image
+     *
+     * The version rotated by rot*360/rotationsNo degrees gets the image ID
+     * rot*baseImagesNo+imageNo.
+     *
+     * Return: -EXIT_FAILURE if one of more of the input paths are invalid,
+     *         EXIT_SUCCESS otherwise
+     */
+    int loadCachedImageFiles(const unsigned int imageNo,
+                             const unsigned int baseImagesNo,
+                             const unsigned int rotationsNo,
+                             const std::vector< std::string > &paths,
+                             imageVersions &versions);
+
+    /**
+     * addImageFiles() - Add the versions of an image that have not been
+     *                   loaded from the cache, storing them into it
+     *
+     * @versions: versions of the image
+     * @decoded : decoded image, mask and (when training) ground-truth
+     *
+     * Return: -EXIT_FAILURE if an image has invalid size or cannot be
+     *         cached while it has to, EXIT_SUCCESS otherwise
+     */
+    int addImageFiles(const imageVersions &versions,
+                      const std::vector< cv::Mat > &decoded);
+
+    /**
+     * computeCacheKey() - Compute the key of the cache entries holding the
+     *                     data computed from a set of input files
+     *
+     * @paths: paths of the input files (image, mask and, when training, gt)
+     * @key  : resulting key (the rotation angle has still to be hashed in)
+     *
+     * Return: -EXIT_FAILURE if one of the files cannot be read, EXIT_SUCCESS
+     *         otherwise
+     */
+    int computeCacheKey(const std::vector< std::string > &paths,
+                        uint64_t &key) const;
+
+    /**
+     * loadCachedImage() - Fill the data of an image from the cache
+     *
+     * @imageID: image ID (corresponding to its position)
+     * @key    : key of the cache entry
+     *
+     * Return: true if the data was found in the cache, false otherwise
+     */
+    bool loadCachedImage(const unsigned int imageID, const uint64_t key);
+
+    /**
+     * storeCachedImage() - Store the data of an image into the cache
+     *
+     * @imageID: image ID (corresponding to its position)
+     * @key    : key of the cache entry
+     *
+     * Return: -EXIT_FAILURE if the entry could not be written, EXIT_SUCCESS
+     *         otherwise
+     */
+    int storeCachedImage(const unsigned int imageID,
+                         const uint64_t key) const;
+
+    /**
+     * releaseChannels() - Drop from memory the channels of an image that
+     *                     has been stored in the cache
+     *
+     * @imageID: image ID (corresponding to its position)
+     * @key    : key of the cache entry holding the channels
+     */
+    void releaseChannels(const unsigned int imageID, const uint64_t key);
+
+    /**
+     * initResidency() - Rebuild the list of resident images from the
+     *                   channels currently held in memory
+     */
+    void initResidency();
+
+    /**
+     * getPlane() - Get a channel of an image, mapping the image back from
+     *              the cache if it is not resident
+     *
+     * @chNo   : number of the desired channel
+     * @imageNo: number of the desired image
+     *
+     * Return: the desired plane
+     */
+    ChannelPlane getPlane(const unsigned int chNo,
+                          const unsigned int imageNo) const;
+
+    /**
+     * gatherSample() - Expand a single sample of a plane to float
+     *
+     * @img      : plane the sample is taken from
+     * @s        : sample position
+     * @rowOffset: row offset to impose while sampling
+     * @colOffset: col offset to impose while sampling
+     * @size     : size of the sample to extract
+     * @dst      : destination buffer (size*size values, row-major)
+     */
+    void gatherSample(const ChannelPlane &img,
+                      const samplePos &s,
+                      const unsigned int rowOffset,
+                      const unsigned int colOffset,
+                      const unsigned int size,
+                      float *dst) const;
+
+    /**
+     * getChsForImage() - Get the leading channels of an image as float
+     *                    buffers enlarged by borderSize (the border is a
+     *                    reflection of the image)
+     *
+     * @n   : image number
+     * @chNo: number of channels to get
+     * @chs : resulting vector containing the desired data
+     */
+    void getChsForImage(const unsigned int n,
+                        const unsigned int chNo,
+                        std::vector< ImageBuffer > &chs) const;
+
+    /**
+     * makeResident() - Map the channels of an image back from the cache,
+     *                  evicting the least recently used images if needed
+     *
+     * @imageNo: number of the image
+     *
+     * Must be called while holding the residency lock.
+     */
+    void makeResident(const unsigned int imageNo) const;
+
+    /**
+     * computeChannelSources() - Compute the intermediate images shared by
+     *                           the channel operations
+     *
+     * @img    : input image (float, 3 channels, in [0, 1])
+     * @sources: bitmask of the intermediates to compute (CH_SRC_*)
+     * @dst    : resulting intermediates
+     */
+    static void computeChannelSources(const cv::Mat &img,
+                                      const unsigned int sources,
+                                      channelSources &dst);
+
+    /**
+     * computeMeanStd() - Compute the mean and the standard deviation of a
+     *                    plane in a single pass
+     *
+     * @src   : input plane (CV_32FC1)
+     * @mean  : output mean
+     * @stdDev: output standard deviation
+     */
+    static void computeMeanStd(const cv::Mat &src,
+                               double &mean,
+                               double &stdDev);
+
+    /**
+     * normalizeChannel() - Normalize a plane to zero mean and unit variance
+     *                      and store it into the destination plane
+     *
+     * @src : input plane (CV_32FC1)
+     * @args: storage of the result (half precision instead of float when
+     *        compact) and normalization to apply
+     * @dst : normalized plane
+     */
+    static void normalizeChannel(const cv::Mat &src,
+                                 const channelOpArgs &args,
+                                 ChannelPlane &dst);
+
+    /**
+     * normalizeQuantizedChannel() - Normalize a plane holding 8-bit values
+     *                               to zero mean and unit variance, keeping
+     *                               the 8-bit codes in compact mode
+     *
+     * @src      : input plane (CV_32FC1), whose values times codeScale are
+     *             integers in [0, 255]
+     * @codeScale: factor mapping the input values to their 8-bit codes
+     * @args     : storage of the result (8-bit codes with the normalization
+     *             folded in their scale and offset instead of float values
+     *             when compact) and normalization to apply
+     * @dst      : normalized plane
+     */
+    static void normalizeQuantizedChannel(const cv::Mat &src,
+                                          const float codeScale,
+                                          const channelOpArgs &args,
+                                          ChannelPlane &dst);
+
+    /**
+     * normalizeCodes() - Normalize a plane of 8-bit codes to zero mean and
+     *                    unit variance
+     *
+     * @codes    : input codes (CV_8UC1)
+     * @codeScale: factor mapping the plane values to their codes
+     * @args     : storage of the result (codes with the normalization folded
+     *             in their scale and offset instead of float values when
+     *             compact) and normalization to apply
+     * @dst      : normalized plane
+     */
+    static void normalizeCodes(const cv::Mat &codes,
+                               const float codeScale,
+                               const channelOpArgs &args,
+                               ChannelPlane &dst);
+
+    /**
+     * accumulateMoments() - Accumulate the moments of a plane into a tile
+     *                       normalization
+     *
+     * @src : input plane (CV_32FC1)
+     * @norm: normalization whose moments are updated
+     */
+    static void accumulateMoments(const cv::Mat &src, channelNorm &norm);
+
     /**
      * imageGrayCh() - Process an image, converting it to grayscale and
      *         pushing it into the corresponding channel of the
      *         dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageGrayCh(const cv::Mat &src, EMat &dst,
+    static int imageGrayCh(const channelSources &src, ChannelPlane &dst,
                            const void *opaque);
 
     /**
@@ -606,13 +1190,14 @@ private:
      *                pushing it into the corresponding channel of the
      *                dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageCLAHE(const cv::Mat &src, EMat &dst,
+    static int imageCLAHE(const channelSources &src, ChannelPlane &dst,
                           const void *opaque);
 
     /**
@@ -620,13 +1205,14 @@ private:
      *          pushing it into the corresponding channel of the
      *          dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageGreenCh(const cv::Mat &src, EMat &dst,
+    static int imageGreenCh(const channelSources &src, ChannelPlane &dst,
                             const void *opaque);
 
     /**
@@ -634,13 +1220,14 @@ private:
      *        pushing it into the corresponding channel of the
      *        dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageRedCh(const cv::Mat &src, EMat &dst,
+    static int imageRedCh(const channelSources &src, ChannelPlane &dst,
                           const void *opaque);
 
     /**
@@ -648,13 +1235,14 @@ private:
      *         pushing it into the corresponding channel of the
      *         dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageBlueCh(const cv::Mat &src, EMat &dst,
+    static int imageBlueCh(const channelSources &src, ChannelPlane &dst,
                            const void *opaque);
 
     /**
@@ -662,13 +1250,14 @@ private:
      *        pushing it into the corresponding channel of the
      *        dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageHueCh(const cv::Mat &src, EMat &dst,
+    static int imageHueCh(const channelSources &src, ChannelPlane &dst,
                           const void *opaque);
 
     /**
@@ -676,13 +1265,14 @@ private:
      *          and pushing it into the corresponding channel of the
      *          dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageSaturCh(const cv::Mat &src, EMat &dst,
+    static int imageSaturCh(const channelSources &src, ChannelPlane &dst,
                             const void *opaque);
 
     /**
@@ -690,13 +1280,14 @@ private:
      *          pushing it into the corresponding channel of the
      *          dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageValueCh(const cv::Mat &src, EMat &dst,
+    static int imageValueCh(const channelSources &src, ChannelPlane &dst,
                             const void *opaque);
 
     /**
@@ -704,13 +1295,14 @@ private:
      *      pushing it into the corresponding channel of the
      *      dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageLCh(const cv::Mat &src, EMat &dst,
+    static int imageLCh(const channelSources &src, ChannelPlane &dst,
                         const void *opaque);
 
     /**
@@ -718,13 +1310,14 @@ private:
      *      pushing it into the corresponding channel of the
      *      dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageACh(const cv::Mat &src, EMat &dst,
+    static int imageACh(const channelSources &src, ChannelPlane &dst,
                         const void *opaque);
 
     /**
@@ -732,13 +1325,14 @@ private:
      *      pushing it into the corresponding channel of the
      *      dataset
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int imageBCh(const cv::Mat &src, EMat &dst,
+    static int imageBCh(const channelSources &src, ChannelPlane &dst,
                         const void *opaque);
 
     /**
@@ -746,39 +1340,42 @@ private:
      *           passing it through a Gaussian filter with sigma
      *           1
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int gaussianFiltering(const cv::Mat &src, EMat &dst,
+    static int gaussianFiltering(const channelSources &src, ChannelPlane &dst,
                                  const void *opaque);
 
     /**
      * laplacianFiltering() - Process an image, taking its green channel and
      *            passing it through a Laplacian filter of size 9
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int laplacianFiltering(const cv::Mat &src, EMat &dst,
+    static int laplacianFiltering(const channelSources &src, ChannelPlane &dst,
                                   const void *opaque);
 
     /**
      * LBP() - Process an image, taking its green channel and
      *         extracting its Local Binary Pattern
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int LBP(const cv::Mat &src, EMat &dst,
+    static int LBP(const channelSources &src, ChannelPlane &dst,
                    const void *opaque);
 
     /**
@@ -787,13 +1384,14 @@ private:
      *             pixel of radius (1.5 would have been better, but
      *             must be > 1, odd, and not fractional in OpenCV)
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int medianFiltering(const cv::Mat &src, EMat &dst,
+    static int medianFiltering(const channelSources &src, ChannelPlane &dst,
                                const void *opaque);
 
     /**
@@ -801,13 +1399,14 @@ private:
      *       passing it through a Sobel derivative filter in the X
      *       direction
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int sobelDrvX(const cv::Mat &src, EMat &dst,
+    static int sobelDrvX(const channelSources &src, ChannelPlane &dst,
                          const void *opaque);
 
     /**
@@ -815,13 +1414,14 @@ private:
      *       passing it through a Sobel derivative filter in the Y
      *       direction
      *
-     * @src   : input image
+     * @src   : intermediates computed on the input image
      * @dst   : converted image
-     * @opaque: opaque pointer to useful data (here: border size)
+     * @opaque: opaque pointer to useful data (here: pointer to the
+     *          channelOpArgs)
      *
      * Return: EXIT_SUCCESS
      */
-    static int sobelDrvY(const cv::Mat &src, EMat &dst,
+    static int sobelDrvY(const channelSources &src, ChannelPlane &dst,
                          const void *opaque);
 
     /**
@@ -829,7 +1429,9 @@ private:
      *         into the dataset
      *
      * @imageID: image ID (corresponding to its position)
-     * @src    : input image mask
+     * @src    : input image mask (float)
+     *
+     * Only the pixels set exactly to MASK_INCLUDED are included.
      *
      * Return: EXIT_SUCCESS
      */
@@ -21,8 +21,10 @@
 #include <vector>
 #include <cassert>
 
+#include "convolution.hpp"
 #include "DataTypes.hpp"
 #include "FilterBank.hpp"
+#include "scheduler.hpp"
 #include "utils.hpp"
 
 #ifdef MOVABLE_TRAIN
@@ -53,8 +55,7 @@ FilterBank::FilterBank(const Parameters &params,
     /* Compute normalization factors for the weights */
     EVec sqrtW = weights.array().sqrt();
 
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int iF = 0; iF < filtersNo; ++iF) {
+    parallelFor(filtersNo, [&](unsigned int iF) {
         /* Randomly-chosen filter size */
         unsigned int filterSize = minFilterSize +
             (unsigned int)rand() % (maxFilterSize - minFilterSize);
@@ -77,6 +78,8 @@ FilterBank::FilterBank(const Parameters &params,
         std::vector< unsigned int > samplesIdx =
             randomSamplingWithoutReplacement(randSamplesNo,
                                              samplePositions.size());
+        /* Gather the samples in image, row and column order */
+        samplePositions.sortIndexes(samplesIdx);
 
         /* Selected smoothing value */
         const EMat &smMat = SM.getSmoothingMatrix(filterSize, lambda);
@@ -123,7 +126,7 @@ FilterBank::FilterBank(const Parameters &params,
             W.coeffRef(iX) = sqrtW.coeff(samplesIdx[iX])*normSumW;
             Y.coeffRef(iX) =
                 W.coeffRef(iX) *
-                samplePositions[samplesIdx[iX]].label;
+                samplePositions.label(samplesIdx[iX]);
         }
         W.tail(smMat.rows()).setConstant(sqrt(lambda));
         /* Smoothing values have no label */
@@ -164,7 +167,7 @@ FilterBank::FilterBank(const Parameters &params,
         /* During learning we keep the filters as columns */
         assert(filters[iF].X.rows() == filterArea);
         assert(filters[iF].X.cols() == 1);
-    }
+    });
 }
 
 FilterBank::FilterBank(const std::vector< FilterBank > &filterBanks,
@@ -197,6 +200,67 @@ FilterBank::FilterBank(std::string &descr_json)
     Deserialize(root);
 }
 
+void
+FilterBank::separateFilters(const float maxError)
+{
+    unsigned int separatedNo = 0;
+    unsigned int termsNo = 0;
+    for (unsigned int iF = 0; iF < filters.size(); ++iF) {
+        filter &flt = filters[iF];
+        Eigen::MatrixXd sq(flt.size, flt.size);
+        for (unsigned int r = 0; r < flt.size; ++r) {
+            for (unsigned int c = 0; c < flt.size; ++c) {
+                sq(r, c) = flt.X(r*flt.size + c, 0);
+            }
+        }
+        Eigen::JacobiSVD< Eigen::MatrixXd >
+            svd(sq, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        const Eigen::VectorXd &sv = svd.singularValues();
+
+        /* The error of the first terms is the norm of the singular values
+           left out */
+        const double maxSqError = maxError*maxError*sv.squaredNorm();
+        unsigned int rank = 1;
+        while (rank < sv.size() &&
+               sv.tail(sv.size()-rank).squaredNorm() > maxSqError) {
+            ++rank;
+        }
+        /* Each term costs a pass on the rows and one on the columns */
+        if (2*rank >= flt.size) {
+            continue;
+        }
+
+        flt.sepCols.create(rank, flt.size, CV_32FC1);
+        flt.sepRows.create(rank, flt.size, CV_32FC1);
+        for (unsigned int t = 0; t < rank; ++t) {
+            const double scale = sqrt(sv(t));
+            for (unsigned int i = 0; i < flt.size; ++i) {
+                flt.sepCols.at< float >(t, i) = scale*svd.matrixU()(i, t);
+                flt.sepRows.at< float >(t, i) = scale*svd.matrixV()(i, t);
+            }
+        }
+
+        /* The dense filter becomes the sum of the terms, so that every way
+           of applying it gives the same responses */
+        for (unsigned int r = 0; r < flt.size; ++r) {
+            for (unsigned int c = 0; c < flt.size; ++c) {
+                float value = 0;
+                for (unsigned int t = 0; t < rank; ++t) {
+                    value += flt.sepCols.at< float >(t, r)*
+                        flt.sepRows.at< float >(t, c);
+                }
+                flt.X(r*flt.size + c, 0) = value;
+                flt.Xsq.at< float >(r, c) = value;
+            }
+        }
+        ++separatedNo;
+        termsNo += rank;
+    }
+    log_info("\t\tSeparated %d/%d filters (%.2f terms on average)",
+             (int)separatedNo, (int)filters.size(),
+             separatedNo > 0 ? (float)termsNo/separatedNo : 0.0f);
+}
+
 #endif // MOVABLE_TRAIN
 
 
@@ -233,62 +297,76 @@ FilterBank::evaluateFilters(const Dataset &dataset,
 
     features.resize(samplePositions.size(), filters.size());
 
+    /* Group the samples by image (and order them by row and column
+       within it), so that each image is touched once per pass:
+       consecutive iterations work on the same image, keeping the number
+       of images in use at any time close to the threads number. The
+       sorted indexes map the features back to the caller's order */
     std::vector< unsigned int > samplesIdx(samplePositions.size());
     std::iota(samplesIdx.begin(), samplesIdx.end(), 0);
+    samplePositions.sortIndexes(samplesIdx);
 
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int iF = 0; iF < filters.size(); ++iF) {
-        EMat samples;
-        dataset.getSampleMatrix(samplePositions,
-                                samplesIdx,
-                                filters[iF].chNo,
-                                filters[iF].row,
-                                filters[iF].col,
-                                filters[iF].size,
-                                samples);
-        features.col(iF) = samples * filters[iF].X;
+    std::vector< unsigned int > groupStart;
+    for (unsigned int i = 0; i < samplesIdx.size(); ++i) {
+        if (i == 0 || samplePositions.imageNo(samplesIdx[i]) !=
+            samplePositions.imageNo(samplesIdx[i-1])) {
+            groupStart.push_back(i);
+        }
     }
+    const unsigned int groupsNo = groupStart.size();
+    groupStart.push_back(samplesIdx.size());
+
+    /* One task for each (group, filter) pair */
+    const unsigned int filtersNo = filters.size();
+    parallelFor(groupsNo*filtersNo, [&](unsigned int task) {
+        const unsigned int g = task/filtersNo;
+        const unsigned int iF = task%filtersNo;
+        const std::vector< unsigned int >
+            groupIdx(samplesIdx.begin()+groupStart[g],
+                     samplesIdx.begin()+groupStart[g+1]);
+        /* Only samples*X is needed: fuse the gather with the product
+           rather than materialising the samples */
+        EVec responses;
+        dataset.getSampleResponses(samplePositions,
+                                   groupIdx,
+                                   filters[iF].chNo,
+                                   filters[iF].row,
+                                   filters[iF].col,
+                                   filters[iF].size,
+                                   filters[iF].X,
+                                   responses);
+        for (unsigned int i = 0; i < groupIdx.size(); ++i) {
+            features(groupIdx[i], iF) = responses(i);
+        }
+    });
 }
 
 void
-FilterBank::evaluateFiltersOnImage(const std::vector< cv::Mat > &imgVec,
-                                   const unsigned int borderSize,
-                                   EMat& features) const
+FilterBank::getChCount(std::vector< int > &count)
 {
-    assert (!imgVec.empty());
-
-    const unsigned int nRows = imgVec[0].rows-2*borderSize;
-    const unsigned int nCols = imgVec[0].cols-2*borderSize;
-    EMat featTmp;
-    featTmp.resize(filters.size(), nRows*nCols);
-
-#pragma omp parallel for schedule(dynamic)
     for (unsigned int iF = 0; iF < filters.size(); ++iF) {
-        cv::Mat tmp;
-        cv::filter2D(imgVec[filters[iF].chNo], tmp,
-                     -1, filters[iF].Xsq);
-        const unsigned int startRow = borderSize+filters[iF].row+
-            floor(filters[iF].size/2)-1;
-        const unsigned int startCol = borderSize+filters[iF].col+
-            floor(filters[iF].size/2)-1;
-        /* We copy data since we cannot reshape a cv::Range
-           (non-contiguous in memory) */
-        for (unsigned int r = 0; r < nRows; ++r) {
-            for (unsigned int c = 0; c < nCols; ++c) {
-                featTmp(iF, r*nCols+c) =
-                    tmp.at< float >(r+startRow, c+startCol);
-            }
-        }
+        count[filters[iF].chNo]++;
     }
-    features = featTmp.transpose();
+}
+
+unsigned int
+FilterBank::getFiltersNo() const
+{
+    return filters.size();
 }
 
 void
-FilterBank::getChCount(std::vector< int > &count)
+FilterBank::getKernel(const unsigned int iF,
+                      unsigned int &chNo,
+                      convKernel &kernel) const
 {
-    for (unsigned int iF = 0; iF < filters.size(); ++iF) {
-        count[filters[iF].chNo]++;
-    }
+    chNo = filters[iF].chNo;
+    kernel.weights = filters[iF].Xsq;
+    kernel.colFactors = filters[iF].sepCols;
+    kernel.rowFactors = filters[iF].sepRows;
+    kernel.row = filters[iF].row;
+    kernel.col = filters[iF].col;
+    kernel.dst = nullptr;
 }
 
 void
@@ -307,6 +385,13 @@ FilterBank::Serialize(Json::Value &root)
         for (unsigned int r = 0; r < filters[i].X.rows(); ++r) {
             f["X"].append(filters[i].X(r, 0));
         }
+        /* Separable terms, one after the other */
+        for (int t = 0; t < filters[i].sepCols.rows; ++t) {
+            for (unsigned int j = 0; j < filters[i].size; ++j) {
+                f["sepCols"].append(filters[i].sepCols.at< float >(t, j));
+                f["sepRows"].append(filters[i].sepRows.at< float >(t, j));
+            }
+        }
 
         filters_json.append(f);
     }
@@ -324,6 +409,12 @@ FilterBank::Deserialize(Json::Value &root)
         flt.row = (*it)["row"].asInt();
         flt.col = (*it)["col"].asInt();
         flt.size = (*it)["size"].asInt();
+        if (flt.size == 0 || (*it)["X"].size() != flt.size*flt.size) {
+            log_err("Invalid filter description: %d weights for a %dx%d "
+                    "filter", (int)(*it)["X"].size(), (int)flt.size,
+                    (int)flt.size);
+            throw std::runtime_error("invalidFilterDescription");
+        }
         flt.X.resize(flt.size*flt.size, 1);
         unsigned int r = 0;
         for (Json::Value::iterator F_it = (*it)["X"].begin();
@@ -339,7 +430,46 @@ FilterBank::Deserialize(Json::Value &root)
             }
         }
         flt.Xsq = tmpSqX;
+        if (readSeparableTerms(*it, flt) != EXIT_SUCCESS) {
+            throw std::runtime_error("invalidFilterDescription");
+        }
 
         filters.push_back(flt);
     }
 }
+
+int
+FilterBank::readSeparableTerms(Json::Value &root, filter &flt)
+{
+    const bool hasCols = root.isMember("sepCols");
+    const bool hasRows = root.isMember("sepRows");
+    if (!hasCols && !hasRows) {
+        return EXIT_SUCCESS;
+    }
+
+    /* Each term is a column factor and a row factor of the filter size */
+    if (hasCols != hasRows ||
+        !root["sepCols"].isArray() || !root["sepRows"].isArray() ||
+        root["sepCols"].size() != root["sepRows"].size() ||
+        root["sepCols"].size() == 0 ||
+        root["sepCols"].size()%flt.size != 0) {
+        log_err("Invalid separable terms for a %dx%d filter "
+                "(column factors: %d values, row factors: %d values)",
+                (int)flt.size, (int)flt.size,
+                (int)root["sepCols"].size(), (int)root["sepRows"].size());
+        return -EXIT_FAILURE;
+    }
+
+    const unsigned int rank = root["sepCols"].size()/flt.size;
+    flt.sepCols.create(rank, flt.size, CV_32FC1);
+    flt.sepRows.create(rank, flt.size, CV_32FC1);
+    for (unsigned int t = 0; t < rank; ++t) {
+        for (unsigned int j = 0; j < flt.size; ++j) {
+            const unsigned int idx = t*flt.size+j;
+            flt.sepCols.at< float >(t, j) = root["sepCols"][idx].asFloat();
+            flt.sepRows.at< float >(t, j) = root["sepRows"][idx].asFloat();
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
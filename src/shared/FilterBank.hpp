@@ -34,6 +34,7 @@
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "convolution.hpp"
 #include "DataTypes.hpp"
 #include "logging.hpp"
 #include "Parameters.hpp"
@@ -93,6 +94,19 @@ public:
      */
     FilterBank(std::string &descr_json);
 
+    /**
+     * separateFilters() - Approximate the filters by sums of separable
+     *                     terms, obtained from their SVD
+     *
+     * @maxError: maximum error of the approximation, relative to the norm
+     *            of the filter
+     *
+     * Each filter keeps the fewest terms within the error bound, and is
+     * replaced by their sum. Filters needing too many terms to be cheaper
+     * than the dense ones are left as they are.
+     */
+    void separateFilters(const float maxError);
+
 #endif // MOVABLE_TRAIN
 
     /**
@@ -146,24 +160,31 @@ public:
                          EMat& features) const;
 
     /**
-     * evaluateFiltersOnImage() - Evaluate the filters over the channels of
-     *                            a specific image
+     * getChCount() - Get the fraction of filters for each specific channel
      *
-     * @imgVec    : vector containing the channels associated with the image
-     * @borderSize: size of the border added to the image before convolution
+     * @count: output filter count
+     */
+    void getChCount(std::vector< int > &count);
+
+    /**
+     * getFiltersNo() - Get the number of filters in the filter bank
      *
-     * @features: resulting features computed using the filters
+     * Return: number of filters
      */
-    void evaluateFiltersOnImage(const std::vector< cv::Mat > &imgVec,
-                                const unsigned int borderSize,
-                                EMat& features) const;
+    unsigned int getFiltersNo() const;
 
     /**
-     * getChCount() - Get the fraction of filters for each specific channel
+     * getKernel() - Get a filter in the form used by the convolution engines
      *
-     * @count: output filter count
+     * @iF    : filter number
+     * @chNo  : channel on which the filter is applied
+     * @kernel: filter weights (along with its separable terms, if any) and
+     *          position of its top-left corner in the sample (the output
+     *          is left unset)
      */
-    void getChCount(std::vector< int > &count);
+    void getKernel(const unsigned int iF,
+                   unsigned int &chNo,
+                   convKernel &kernel) const;
 
     /**
      * Serialize() - Serialize a filter bank in JSON format
@@ -182,6 +203,10 @@ private:
      * @size   : filter size
      * @X      : filter shaped as a column vector
      * @Xsq    : filter shaped as a square in cv::Mat format
+     * @sepCols: column factors of the separable terms of the filter, one
+     *           per row (empty if the filter is dense)
+     * @sepRows: row factors of the separable terms of the filter, one per
+     *           row (empty if the filter is dense)
      */
     typedef struct filter {
         unsigned int chNo;
@@ -190,6 +215,8 @@ private:
         unsigned int size;
         EMat X;
         cv::Mat Xsq;
+        cv::Mat sepCols;
+        cv::Mat sepRows;
 
         /**
          * operator==() - Compare two filtes for equality
@@ -208,7 +235,9 @@ private:
                 flt1.col == flt2.col &&
                 flt1.size == flt2.size &&
                 flt1.X == flt2.X &&
-                cvMatEquals(flt1.Xsq, flt2.Xsq)) {
+                cvMatEquals(flt1.Xsq, flt2.Xsq) &&
+                cvMatEquals(flt1.sepCols, flt2.sepCols) &&
+                cvMatEquals(flt1.sepRows, flt2.sepRows)) {
                 return true;
             }
             return false;
@@ -237,6 +266,18 @@ private:
      */
     virtual void Deserialize(Json::Value &root);
 
+    /**
+     * readSeparableTerms() - Read the separable terms of a filter from its
+     *                        JSON description
+     *
+     * @root: JSON description of the filter
+     * @flt : filter whose terms are read (its size is already known)
+     *
+     * Return: -EXIT_FAILURE if the terms are malformed, EXIT_SUCCESS
+     *         otherwise (filters without terms included)
+     */
+    static int readSeparableTerms(Json::Value &root, filter &flt);
+
     std::vector< filter > filters;
 };
 
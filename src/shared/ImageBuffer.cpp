@@ -0,0 +1,65 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <cassert>
+
+#include "ImageBuffer.hpp"
+
+ImageBuffer::ImageBuffer()
+{
+}
+
+ImageBuffer::ImageBuffer(const int rows, const int cols)
+{
+    /* Allocate padded rows, then hide the padding */
+    const int stride = (cols+IMAGE_BUFFER_ROW_ALIGN-1)/
+        IMAGE_BUFFER_ROW_ALIGN*IMAGE_BUFFER_ROW_ALIGN;
+    cv::Mat padded(rows, stride, CV_32FC1);
+    buffer = padded.colRange(0, cols);
+}
+
+ImageBuffer::ImageBuffer(const cv::Mat &src)
+    : buffer(src)
+{
+    assert(src.empty() || src.type() == CV_32FC1);
+}
+
+ImageBuffer
+ImageBuffer::view(EMat &src)
+{
+    return ImageBuffer(cv::Mat(src.rows(), src.cols(), CV_32FC1,
+                               src.data()));
+}
+
+const ImageBuffer
+ImageBuffer::view(const EMat &src)
+{
+    return ImageBuffer(cv::Mat(src.rows(), src.cols(), CV_32FC1,
+                               const_cast< float * >(src.data())));
+}
+
+ImageBuffer
+ImageBuffer::roi(const int row, const int col,
+                 const int rows, const int cols) const
+{
+    assert(row >= 0 && col >= 0);
+    assert(row+rows <= buffer.rows && col+cols <= buffer.cols);
+
+    return ImageBuffer(buffer(cv::Rect(col, row, cols, rows)));
+}
@@ -0,0 +1,182 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef IMAGEBUFFER_HPP_
+#define IMAGEBUFFER_HPP_
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include <Eigen/Core>
+#include <opencv2/opencv.hpp>
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+#include "DataTypes.hpp"
+
+/* Row stride granularity of the allocated buffers, in floats (64 bytes) */
+const int IMAGE_BUFFER_ROW_ALIGN = 16;
+
+typedef Eigen::Map< EMat, Eigen::Unaligned,
+                    Eigen::OuterStride<> > EMatView;
+typedef Eigen::Map< const EMat, Eigen::Unaligned,
+                    Eigen::OuterStride<> > EConstMatView;
+
+/**
+ * class ImageBuffer - Single-channel float image that can be viewed both as
+ *                     an OpenCV matrix and as an Eigen matrix without
+ *                     copying
+ *
+ * @buffer: underlying OpenCV matrix (CV_32FC1), holding either a refcounted
+ *          allocation or a view on memory owned by someone else
+ *
+ * Allocated buffers pad each row to a multiple of 64 bytes. Copies and
+ * regions of interest share the memory of the source buffer.
+ */
+class ImageBuffer {
+public:
+    /**
+     * ImageBuffer() - Create an empty buffer
+     */
+    ImageBuffer();
+
+    /**
+     * ImageBuffer() - Allocate an uninitialized buffer
+     *
+     * @rows: number of rows of the buffer
+     * @cols: number of columns of the buffer
+     */
+    ImageBuffer(const int rows, const int cols);
+
+    /**
+     * ImageBuffer() - Share the memory of an OpenCV matrix
+     *
+     * @src: source matrix (CV_32FC1)
+     */
+    explicit ImageBuffer(const cv::Mat &src);
+
+    /**
+     * view() - Create a buffer pointing to the values of an Eigen matrix
+     *
+     * @src: source matrix, which has to outlive the returned buffer
+     *
+     * Return: buffer sharing the values of src
+     */
+    static ImageBuffer view(EMat &src);
+
+    /**
+     * view() - Create a read-only buffer pointing to the values of an Eigen
+     *          matrix
+     *
+     * @src: source matrix, which has to outlive the returned buffer
+     *
+     * The values must not be modified through the returned buffer.
+     *
+     * Return: buffer sharing the values of src
+     */
+    static const ImageBuffer view(const EMat &src);
+
+    /**
+     * rows() - Get the number of rows of the buffer
+     *
+     * Return: number of rows
+     */
+    int rows() const { return buffer.rows; }
+
+    /**
+     * cols() - Get the number of columns of the buffer
+     *
+     * Return: number of columns
+     */
+    int cols() const { return buffer.cols; }
+
+    /**
+     * empty() - Check whether the buffer holds no values
+     *
+     * Return: true if the buffer is empty, false otherwise
+     */
+    bool empty() const { return buffer.empty(); }
+
+    /**
+     * ptr() - Get a pointer to the beginning of a row
+     *
+     * @r: row number
+     *
+     * Return: pointer to the first value of the row
+     */
+    float *ptr(const int r) { return buffer.ptr< float >(r); }
+
+    /**
+     * ptr() - Get a read-only pointer to the beginning of a row
+     *
+     * @r: row number
+     *
+     * Return: pointer to the first value of the row
+     */
+    const float *ptr(const int r) const { return buffer.ptr< float >(r); }
+
+    /**
+     * mat() - Get an OpenCV view of the buffer
+     *
+     * Return: matrix sharing the memory of the buffer
+     */
+    const cv::Mat& mat() const { return buffer; }
+
+    /**
+     * map() - Get an Eigen view of the buffer
+     *
+     * Return: map sharing the memory of the buffer
+     */
+    EMatView map()
+    {
+        return EMatView(buffer.ptr< float >(), buffer.rows, buffer.cols,
+                        Eigen::OuterStride<>(buffer.step1()));
+    }
+
+    /**
+     * map() - Get a read-only Eigen view of the buffer
+     *
+     * Return: map sharing the memory of the buffer
+     */
+    EConstMatView map() const
+    {
+        return EConstMatView(buffer.ptr< float >(), buffer.rows, buffer.cols,
+                             Eigen::OuterStride<>(buffer.step1()));
+    }
+
+    /**
+     * roi() - Get a region of interest of the buffer
+     *
+     * @row : first row of the region
+     * @col : first column of the region
+     * @rows: number of rows of the region
+     * @cols: number of columns of the region
+     *
+     * The region keeps track of its position in the source buffer, so that
+     * OpenCV filters applied on it read the surrounding pixels.
+     *
+     * Return: buffer sharing the memory of the region
+     */
+    ImageBuffer roi(const int row, const int col,
+                    const int rows, const int cols) const;
+
+private:
+    cv::Mat buffer;
+};
+
+#endif /* IMAGEBUFFER_HPP_ */
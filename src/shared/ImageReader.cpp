@@ -0,0 +1,102 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <algorithm>
+
+#include "ImageReader.hpp"
+#include "logging.hpp"
+
+ImageReader::ImageReader(const std::vector< std::vector< std::string > > &paths,
+                         const std::vector< int > &flags,
+                         const unsigned int readersNo,
+                         const unsigned int queueDepth)
+    : paths(paths), flags(flags), queueDepth(std::max(queueDepth, 1U)),
+      nextSet(0), pending(0), stopping(false)
+{
+    const unsigned int threadsNo =
+        std::min(std::max(readersNo, 1U), (unsigned int)paths.size());
+    for (unsigned int i = 0; i < threadsNo; ++i) {
+        readers.push_back(std::thread(&ImageReader::readerLoop, this));
+    }
+}
+
+ImageReader::~ImageReader()
+{
+    {
+        std::lock_guard< std::mutex > guard(lock);
+        stopping = true;
+    }
+    slotFree.notify_all();
+    for (unsigned int i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+}
+
+void
+ImageReader::readerLoop()
+{
+    std::unique_lock< std::mutex > guard(lock);
+    while (true) {
+        slotFree.wait(guard, [this] {
+                return stopping || nextSet >= paths.size() ||
+                    pending < queueDepth;
+            });
+        if (stopping || nextSet >= paths.size()) {
+            return;
+        }
+        const unsigned int idx = nextSet++;
+        ++pending;
+
+        /* Decode without holding the lock, the other readers go on */
+        guard.unlock();
+        std::vector< cv::Mat > images(paths[idx].size());
+        for (unsigned int i = 0; i < paths[idx].size(); ++i) {
+            images[i] = cv::imread(paths[idx][i].c_str(), flags[i]);
+        }
+        guard.lock();
+
+        decoded[idx].swap(images);
+        setReady.notify_all();
+    }
+}
+
+int
+ImageReader::take(const unsigned int idx, std::vector< cv::Mat > &images)
+{
+    {
+        std::unique_lock< std::mutex > guard(lock);
+        setReady.wait(guard, [this, idx] {
+                return decoded.find(idx) != decoded.end();
+            });
+        auto it = decoded.find(idx);
+        images.swap(it->second);
+        decoded.erase(it);
+        --pending;
+    }
+    slotFree.notify_one();
+
+    for (unsigned int i = 0; i < images.size(); ++i) {
+        if (images[i].empty()) {
+            log_err("Unable to decode %s", paths[idx][i].c_str());
+            return -EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
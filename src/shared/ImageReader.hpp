@@ -0,0 +1,117 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef IMAGEREADER_HPP_
+#define IMAGEREADER_HPP_
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include <opencv2/opencv.hpp>
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+/**
+ * class ImageReader - Pool of reader threads decoding sets of image files
+ *                     ahead of their use, into a bounded queue
+ *
+ * @paths     : for each set, the paths of the files to decode
+ * @flags     : imread() flags of each file of a set
+ * @queueDepth: maximum number of sets decoded (or being decoded) and not
+ *              taken yet
+ * @nextSet   : index of the next set to decode
+ * @pending   : number of sets decoded (or being decoded) and not taken yet
+ * @stopping  : true when the readers have to quit
+ * @decoded   : decoded sets, waiting to be taken
+ * @lock      : lock protecting the queue state
+ * @setReady  : signalled when a set has been decoded
+ * @slotFree  : signalled when a set has been taken
+ * @readers   : reader threads
+ *
+ * Sets are decoded in order, hence taking them in (roughly) increasing order
+ * is required: a consumer waiting for a set that cannot be decoded because
+ * the queue is full of later sets would wait forever. A parallelFor() loop
+ * satisfies this, as its iterations are claimed in order.
+ *
+ * The reader threads are not part of the scheduler: they come on top of
+ * its threads budget. They spend most of their time reading and decoding
+ * files, and a consumer blocked in take() leaves its core to them.
+ */
+class ImageReader {
+public:
+    /**
+     * ImageReader() - Start the reader threads
+     *
+     * @paths     : for each set, the paths of the files to decode
+     * @flags     : imread() flags of each file of a set
+     * @readersNo : number of reader threads (on top of the scheduler's)
+     * @queueDepth: maximum number of sets decoded ahead of their use
+     */
+    ImageReader(const std::vector< std::vector< std::string > > &paths,
+                const std::vector< int > &flags,
+                const unsigned int readersNo,
+                const unsigned int queueDepth);
+
+    /**
+     * ~ImageReader() - Stop the reader threads, dropping the sets that have
+     *                  not been taken
+     */
+    ~ImageReader();
+
+    ImageReader(const ImageReader &) = delete;
+    ImageReader &operator=(const ImageReader &) = delete;
+
+    /**
+     * take() - Wait for a set to be decoded, then remove it from the queue
+     *
+     * @idx   : index of the set
+     * @images: output decoded images, in the order of the paths
+     *
+     * Return: -EXIT_FAILURE if one of the files could not be decoded,
+     *         EXIT_SUCCESS otherwise
+     */
+    int take(const unsigned int idx, std::vector< cv::Mat > &images);
+
+private:
+    std::vector< std::vector< std::string > > paths;
+    std::vector< int > flags;
+    unsigned int queueDepth;
+    unsigned int nextSet;
+    unsigned int pending;
+    bool stopping;
+    std::map< unsigned int, std::vector< cv::Mat > > decoded;
+    std::mutex lock;
+    std::condition_variable setReady;
+    std::condition_variable slotFree;
+    std::vector< std::thread > readers;
+
+    /**
+     * readerLoop() - Body of the reader threads: decode the sets in order
+     *                while there is room in the queue
+     */
+    void readerLoop();
+};
+
+#endif /* IMAGEREADER_HPP_ */
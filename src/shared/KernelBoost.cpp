@@ -23,7 +23,9 @@
 #include <ctime>
 #include <chrono>
 
+#include "CompiledModel.hpp"
 #include "KernelBoost.hpp"
+#include "scheduler.hpp"
 
 #ifdef MOVABLE_TRAIN
 /* Constructor used in the training phase */
@@ -73,15 +75,14 @@ KernelBoost::KernelBoost(Parameters &params,
 #if 0
     std::vector< cv::Mat > scoreImages(dataset_final.getImagesNo());
     /* Perform the final classification on training images */
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < dataset_final.getImagesNo(); ++i) {
+    parallelFor(dataset_final.getImagesNo(), [&](unsigned int i) {
         std::chrono::time_point< std::chrono::system_clock > start;
         std::chrono::time_point< std::chrono::system_clock > end;
         start = std::chrono::system_clock::now();
 
         EMat result;
         if (params.fastClassifier) {
-            const sampleSet& ePoints = dataset_final.getEPoints(i);
+            const runSet& ePoints = dataset_final.getEPoints(i);
             finalClassifier->classifyImage(dataset_final,
                                            i,
                                            ePoints,
@@ -91,29 +92,25 @@ KernelBoost::KernelBoost(Parameters &params,
              * Prepare a vector containing the set of OpenCV
              * matrices corresponding to the available channels
              */
-            std::vector< cv::Mat > chs;
+            std::vector< ImageBuffer > chs;
             dataset_final.getChsForImage(i, chs);
             finalClassifier->classifyFullImage(chs,
                                                dataset_final.getBorderSize(),
                                                result);
         }
-        normalizeImage(result,
-                       dataset_final.getBorderSize(),
-                       scoreImages[i]);
+        normalizeImage(result, scoreImages[i]);
 #ifndef TESTS
         saveClassifiedImage(result,
                             params.finalResDir,
-                            dataset_final.getImageName(i),
-                            dataset_final.getBorderSize());
-        float MR = computeMR(result, dataset_final.getGt(0, i),
-                             dataset_final.getBorderSize());
+                            dataset_final.getImageName(i));
+        float MR = computeMR(result, dataset_final.getGt(0, i));
         end = std::chrono::system_clock::now();
         std::chrono::duration< double > elapsed_s = end-start;
         log_info("\t\tImage %d/%d DONE! (took %.3fs, MR=%.3f)",
                  i+1, dataset_final.getImagesNo(),
                  elapsed_s.count(), MR);
 #endif // !TESTS
-    }
+    });
 
     binaryThreshold = params.threshold;
 
@@ -125,8 +122,7 @@ KernelBoost::KernelBoost(Parameters &params,
                              binaryThreshold,
                              params.finalResDir,
                              dataset_final.getImageName(i),
-                             dataset_final.getOriginalImgSize(i),
-                             dataset_final.getBorderSize());
+                             dataset_final.getOriginalImgSize(i));
     }
 
     /* Save WL distribution statistics */
@@ -224,7 +220,17 @@ KernelBoost::KernelBoost(std::string &descr_json,
 
     Deserialize(root);
 
-    if (params.useAutoContext) {
+    /* Filters shared by several weak learners are applied only once */
+    log_info("Final classifier compiled: %d distinct filters for %d "
+             "features",
+             (int)finalClassifier->getCompiledModel().getKernelsNo(),
+             (int)finalClassifier->getCompiledModel().getFeaturesNo());
+
+    if (dataset.isTiled()) {
+        /* The individual pairs are classified along with the final
+           classification, tile by tile */
+        data_to_use = &dataset;
+    } else if (params.useAutoContext) {
         log_info("Start by performing individual pairs classification...");
         Dataset *dataset_final = new Dataset(dataset, boostedClassifiers);
 
@@ -242,11 +248,54 @@ KernelBoost::KernelBoost(std::string &descr_json,
     start = std::chrono::system_clock::now();
 #endif // !TESTS
 
-// #pragma omp parallel for schedule(dynamic)
-    for (unsigned int i = 0; i < data_to_use->getImagesNo(); ++i) {
+    /*
+     * Images are classified concurrently, the threads left idle by the
+     * images picking up the filters and the trees of the ones in progress.
+     * Streamed images flow through loading, classification and saving on
+     * their own
+     */
+    const bool streamed = data_to_use->isStreamed();
+    const unsigned int maxImages = streamed ?
+        data_to_use->getImagesInFlight() : params.concurrentImagesNo;
+    if (maxImages > 0) {
+        log_info("Classifying up to %d image(s) at a time", (int)maxImages);
+    }
+
+    /*
+     * Each classification in progress takes its share of the memory
+     * budget of the filter responses. Without a limit there is one image
+     * per thread, and tiles are classified one per thread as well
+     */
+    const unsigned int threadsNo = getSchedulerThreadsNo();
+    const unsigned int classificationsNo =
+        maxImages > 0 && !data_to_use->isTiled() ?
+        std::min(maxImages, threadsNo) : threadsNo;
+    CompiledModel::setBandBytes(((size_t)params.responsePlanesMB << 20)/
+                                classificationsNo);
+    parallelFor(data_to_use->getImagesNo(), [&](unsigned int i) {
+        if (streamed && data_to_use->loadImage(i) != EXIT_SUCCESS) {
+            log_err("Error encountered while loading image %d/%d",
+                    (int)i+1, (int)data_to_use->getImagesNo());
+            throw std::runtime_error("imageLoading");
+        }
+
+        /* Tiled images keep their scores on a scratch file rather than
+           in memory */
         EMat result;
-        if (params.fastClassifier) {
-            const sampleSet& ePoints = data_to_use->getEPoints(i);
+        ChannelPlane tiledResult;
+        if (data_to_use->isTiled()) {
+            const std::vector< BoostedClassifier * > noClassifiers;
+            if (data_to_use->classifyImageTiled(i,
+                                                params.useAutoContext ?
+                                                boostedClassifiers :
+                                                noClassifiers,
+                                                *finalClassifier,
+                                                tiledResult) !=
+                EXIT_SUCCESS) {
+                throw std::runtime_error("tiledClassification");
+            }
+        } else if (params.fastClassifier) {
+            const runSet& ePoints = data_to_use->getEPoints(i);
             finalClassifier->classifyImage(*data_to_use,
                                            i,
                                            ePoints,
@@ -254,30 +303,35 @@ KernelBoost::KernelBoost(std::string &descr_json,
         } else {
             /*
              * Prepare a vector containing the set of OpenCV matrices
-             * corresponding to the available channels
+             * corresponding to the available channels. The pixels outside
+             * the mask are discarded when thresholding: skip them
              */
-            std::vector< cv::Mat > chs;
+            std::vector< ImageBuffer > chs;
             data_to_use->getChsForImage(i, chs);
             finalClassifier->classifyFullImage(chs,
                                                data_to_use->getBorderSize(),
-                                               result);
+                                               result,
+                                               &data_to_use->getMask(i));
         }
 #ifndef TESTS
-        saveClassifiedImage(result,
+        const cv::Mat scores = data_to_use->isTiled() ?
+            cv::Mat(tiledResult.rows(), tiledResult.cols(), CV_32FC1,
+                    const_cast< unsigned char * >(tiledResult.getValues())) :
+            ImageBuffer::view(result).mat();
+        saveClassifiedImage(scores,
                             params.baseResDir,
                             data_to_use->getImageName(i),
-                            data_to_use->getBorderSize());
+                            &data_to_use->getMask(i));
 
-        cv::Mat imgToThreshold(result.rows(), result.cols(), CV_32FC1);
-        // cv::Mat imgToThreshold(result.rows(), result.cols(), CV_8UC1);
-        cv::eigen2cv(result, imgToThreshold);
+        /* saveThresholdedImage() normalizes its input in place, which is
+           fine as the result is not used afterwards */
+        const cv::Mat imgToThreshold = scores;
         saveThresholdedImage(imgToThreshold,
                              data_to_use->getMask(i),
                              params.threshold,
                              params.baseResDir,
                              data_to_use->getImageName(i),
-                             data_to_use->getOriginalImgSize(i),
-                             data_to_use->getBorderSize());
+                             data_to_use->getOriginalImgSize(i));
 
         saveOverlayedImage(data_to_use->getImagePath(i),
                            params.baseResDir,
@@ -292,23 +346,16 @@ KernelBoost::KernelBoost(std::string &descr_json,
          * followed by thresholding with a fixed threshold specified in
          * the configuration file
          */
-        // normalizeImage(result, dataset_final.getBorderSize(), normImage);
-        cv::Mat beforeCrop(result.rows(), result.cols(), CV_32FC1);
-        cv::eigen2cv(result, beforeCrop);
-
-        /* Drop border */
-        normImage = beforeCrop(cv::Range(data_to_use->getBorderSize(),
-                                         beforeCrop.rows-data_to_use->getBorderSize()),
-                               cv::Range(data_to_use->getBorderSize(),
-                                         beforeCrop.cols-data_to_use->getBorderSize()));
+        // normalizeImage(result, normImage);
+        normImage.create(result.rows(), result.cols(), CV_32FC1);
+        cv::eigen2cv(result, normImage);
 
         saveThresholdedImage(normImage,
                              data_to_use->getMask(i),
                              params.threshold,
                              params.baseResDir,
                              data_to_use->getImageName(i),
-                             data_to_use->getOriginalImgSize(i),
-                             data_to_use->getBorderSize());
+                             data_to_use->getOriginalImgSize(i));
 
         saveOverlayedImage(data_to_use->getImagePath(i),
                            params.baseResDir,
@@ -317,7 +364,11 @@ KernelBoost::KernelBoost(std::string &descr_json,
         log_info("\t\tImage %d/%d DONE!",
                  i+1, data_to_use->getImagesNo());
 #endif // !TESTS
-    }
+
+        if (streamed || data_to_use->isTiled()) {
+            data_to_use->releaseImage(i);
+        }
+    }, maxImages);
 #ifndef TESTS
     end = std::chrono::system_clock::now();
     std::chrono::duration< double > elapsed_s = end-start;
@@ -471,6 +522,7 @@ KernelBoost::serialize(Json::Value &root, const Parameters &params)
     for (unsigned int i = 0; i < params.channelList.size(); ++i) {
         kb_json["Channels"].append(params.channelList[i]);
     }
+    kb_json["compactChannels"] = params.compactChannels;
 
     root["KernelBoost"] = kb_json;
 }
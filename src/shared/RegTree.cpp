@@ -18,6 +18,7 @@
 #include <algorithm>
 
 #include "RegTree.hpp"
+#include "scheduler.hpp"
 
 RegTree::RegTree(const EMat &featuresF,
                  const EVec &responsesF,
@@ -89,11 +90,10 @@ RegTree::RegTree(const EMat &featuresF,
 
         /* Learn a stump for each possible feature */
         std::vector < struct StumpNode > stumpResults(featuresNo);
-#pragma omp parallel for schedule(dynamic)
-        for (unsigned int iFeat = 0; iFeat < featuresNo; ++iFeat) {
+        parallelFor(featuresNo, [&](unsigned int iFeat) {
             trainStump(features, responses, weights,
                        top.idxs, iFeat, stumpResults[iFeat]);
-        }
+        });
 
         /* Find the best-performing stump */
         bestStump = std::min_element(stumpResults.begin(),
@@ -226,10 +226,8 @@ operator!=(const RegTree &rt1, const RegTree &rt2)
 }
 
 void
-RegTree::predict(const EMat &X_, EVec &results) const
+RegTree::predict(const EMat &X, EVec &results) const
 {
-    const EMatD X = X_.cast< double >();
-
     assert(X.rows() > 0);
     assert(X.cols() > 0);
     assert(nodes.size() > 0);
@@ -237,22 +235,12 @@ RegTree::predict(const EMat &X_, EVec &results) const
     const unsigned int samplesNo = X.rows();
     results.resize(samplesNo);
 
-#pragma omp parallel for schedule(dynamic)
-    for (unsigned int iS = 0; iS < samplesNo; ++iS) {
-        unsigned int curNode = 0;
-        while (true) {
-            if (nodes[curNode].isLeaf) {
-                results(iS) = nodes[curNode].n;
-                break;
-            }
-
-            if (X(iS, nodes[curNode].featIdx) < nodes[curNode].n) {
-                curNode = nodes[curNode].lIdx;
-            } else {
-                curNode = nodes[curNode].rIdx;
-            }
-        }
-    }
+    /* Samples are cheap to classify: claim them in batches */
+    parallelFor(samplesNo, [&](unsigned int iS) {
+        results(iS) = predictSample([&](unsigned int iF) {
+            return X(iS, iF);
+        });
+    }, 0, 1024);
 
 }
 
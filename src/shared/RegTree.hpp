@@ -106,6 +106,31 @@ public:
      */
     void predict(const EMat &X, EVec &results) const;
 
+    /**
+     * predictSample() - Given the learnt regression tree, perform prediction
+     *                   on a single sample whose features are read on demand
+     *
+     * @feature: callable returning the value of the feature of given index
+     *
+     * Return: predicted value
+     *
+     * Only the features met along the path of the sample are read, so that
+     * the caller does not have to gather all of them beforehand.
+     */
+    template< typename FeatureFn >
+    float predictSample(const FeatureFn &feature) const
+    {
+        unsigned int curNode = 0;
+        while (!nodes[curNode].isLeaf) {
+            if (feature(nodes[curNode].featIdx) < nodes[curNode].n) {
+                curNode = nodes[curNode].lIdx;
+            } else {
+                curNode = nodes[curNode].rIdx;
+            }
+        }
+        return nodes[curNode].n;
+    }
+
     /**
      * Serialize() - Serialize a regression tree in JSON format
      *
@@ -58,6 +58,19 @@ WeakLearner::WeakLearner(const Parameters &params,
     splitSampleSet(samplePositions, labels, weights, subsetSize,
                    samples_fl, samples_tree, Y_fl, Y_tree, W_fl, W_tree);
 
+    /*
+     * The subsets come out in random order: sort them by position, so that
+     * gathering their patches streams through each image once, and permute
+     * labels and weights accordingly
+     */
+    std::vector< unsigned int > order;
+    samples_fl.sortByPosition(order);
+    permuteVector(order, Y_fl);
+    permuteVector(order, W_fl);
+    samples_tree.sortByPosition(order);
+    permuteVector(order, Y_tree);
+    permuteVector(order, W_tree);
+
     /*
      * For each channel, learn a filter bank and compute the features for
      * tree learning
@@ -107,6 +120,9 @@ WeakLearner::WeakLearner(const Parameters &params,
     /* Build a new filter bank with the retained filters */
     fb = new FilterBank(filterBanks, retainedFeatIdxs);
     filterBanks.clear();
+    if (params.separableMaxError > 0) {
+        fb->separateFilters(params.separableMaxError);
+    }
 
     /*
      * Evaluate the filter bank on the samples ("features" can be reused
@@ -225,19 +241,10 @@ void WeakLearner::evaluate(const Dataset &dataset,
     predictions *= alpha;
 }
 
-void
-WeakLearner::evaluateOnImage(const std::vector< cv::Mat > &imgVec,
-                             const unsigned int borderSize,
-                             EMat &wlResponse) const
+const FilterBank &
+WeakLearner::getFilterBank() const
 {
-    EMat features;
-    fb->evaluateFiltersOnImage(imgVec, borderSize, features);
-    EVec treeResponse;
-    rt->predict(features, treeResponse);
-    wlResponse = Eigen::Map< EMat >(treeResponse.data(),
-                                    imgVec[0].rows-2*borderSize,
-                                    imgVec[0].cols-2*borderSize);
-    wlResponse *= alpha;
+    return *fb;
 }
 
 void WeakLearner::getChCount(std::vector< int > &count)
@@ -152,24 +152,33 @@ public:
                   EVec &predictions) const;
 
     /**
-     * evaluate() - Evaluate a weak learner on a given image
+     * getChCount() - Get the fraction of filters for each specific channel
      *
-     * @imgVec    : image vector
-     * @borderSize: size of the border
+     * @count: output filter count
+     */
+    void getChCount(std::vector< int > &count);
+
+    /**
+     * getFilterBank() - Get the filter bank of the weak learner
      *
-     * @wlResponse: resulting (weighted) predictions for the current weak
-     *              learner on the considered image
+     * Return: filter bank computing the features of the tree
      */
-    void evaluateOnImage(const std::vector< cv::Mat > &imgVec,
-                         const unsigned int borderSize,
-                         EMat &wlResponse) const;
+    const FilterBank &getFilterBank() const;
 
     /**
-     * getChCount() - Get the fraction of filters for each specific channel
+     * predictSample() - Evaluate the weak learner on a single pixel whose
+     *                   features are read on demand
      *
-     * @count: output filter count
+     * @feature: callable returning the value of the feature of given index,
+     *           in filter bank order
+     *
+     * Return: resulting (weighted) prediction for the current weak learner
      */
-    void getChCount(std::vector< int > &count);
+    template< typename FeatureFn >
+    float predictSample(const FeatureFn &feature) const
+    {
+        return (float)alpha*rt->predictSample(feature);
+    }
 
     /**
      * getLoss() - Return the weak learner's loss on train data
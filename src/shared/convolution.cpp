@@ -0,0 +1,460 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+#include <tuple>
+
+#include "convolution.hpp"
+#include "DataTypes.hpp"
+#include "logging.hpp"
+#include "scheduler.hpp"
+
+/* Size of the unrolled source multiplied at once by the GEMM engine */
+static const size_t GEMM_BAND_BYTES = 8 << 20;
+
+/* Batches on which the engines are timed */
+static const unsigned int CALIBRATION_SIZES[] = { 3, 7, 11, 15, 21 };
+static const unsigned int CALIBRATION_COUNTS[] = { 1, 4, 16 };
+static const unsigned int CALIBRATION_SIDES[] = { 64, 256 };
+static const unsigned int CALIBRATION_SIZES_NO =
+    sizeof(CALIBRATION_SIZES)/sizeof(CALIBRATION_SIZES[0]);
+static const unsigned int CALIBRATION_COUNTS_NO =
+    sizeof(CALIBRATION_COUNTS)/sizeof(CALIBRATION_COUNTS[0]);
+static const unsigned int CALIBRATION_SIDES_NO =
+    sizeof(CALIBRATION_SIDES)/sizeof(CALIBRATION_SIDES[0]);
+/* Range of the kernel offsets in the calibration batches (a sample) */
+static const unsigned int CALIBRATION_PATCH = 21;
+
+static void
+correlateDirect(const cv::Mat &src,
+                const unsigned int rows,
+                const unsigned int cols,
+                const std::vector< convKernel > &kernels)
+{
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        /* Filter only the needed region (the pixels around it are read
+           from the source), writing the responses straight into the
+           output */
+        const convKernel &kernel = kernels[k];
+        const cv::Mat region = src(cv::Rect(kernel.col+kernel.weights.cols/2,
+                                            kernel.row+kernel.weights.rows/2,
+                                            cols, rows));
+        cv::Mat dst(rows, cols, CV_32FC1, kernel.dst);
+        if (kernel.colFactors.empty()) {
+            cv::filter2D(region, dst, -1, kernel.weights);
+            continue;
+        }
+
+        cv::Mat term;
+        for (int t = 0; t < kernel.colFactors.rows; ++t) {
+            cv::sepFilter2D(region, t == 0 ? dst : term, -1,
+                            kernel.rowFactors.row(t),
+                            kernel.colFactors.row(t));
+            if (t > 0) {
+                dst += term;
+            }
+        }
+    }
+}
+
+static void
+correlateGemm(const cv::Mat &src,
+              const unsigned int rows,
+              const unsigned int cols,
+              const std::vector< convKernel > &kernels)
+{
+    unsigned int r0 = UINT_MAX;
+    unsigned int c0 = UINT_MAX;
+    unsigned int kRows = 0;
+    unsigned int kCols = 0;
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        r0 = std::min(r0, kernels[k].row);
+        c0 = std::min(c0, kernels[k].col);
+        kRows = std::max(kRows, (unsigned int)kernels[k].weights.rows);
+        kCols = std::max(kCols, (unsigned int)kernels[k].weights.cols);
+    }
+    unsigned int maxDr = 0;
+    unsigned int maxDc = 0;
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        maxDr = std::max(maxDr, kernels[k].row-r0);
+        maxDc = std::max(maxDc, kernels[k].col-c0);
+    }
+    const unsigned int area = kRows*kCols;
+
+    /* Kernels are embedded in the top-left corner of the largest one */
+    EMat weights = EMat::Zero(kernels.size(), area);
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        const cv::Mat &w = kernels[k].weights;
+        for (int i = 0; i < w.rows; ++i) {
+            for (int j = 0; j < w.cols; ++j) {
+                weights(k, i*kCols+j) = w.at< float >(i, j);
+            }
+        }
+    }
+
+    /*
+     * The source is unrolled on a grid extended by the largest offset of
+     * the kernels, so that a single product gives the responses of all of
+     * them: each kernel then picks its own shifted window of the grid
+     */
+    const unsigned int extCols = cols+maxDc;
+    const size_t rowBytes = sizeof(float)*area*extCols;
+    const unsigned int bandRows =
+        std::max(GEMM_BAND_BYTES/rowBytes, (size_t)maxDr+1)-maxDr;
+    EMat unrolled;
+    EMat responses;
+    for (unsigned int y0 = 0; y0 < rows; y0 += bandRows) {
+        const unsigned int y1 = std::min(y0+bandRows, rows);
+        const unsigned int extRows = y1-y0+maxDr;
+        unrolled.resize(area, extRows*extCols);
+        for (unsigned int i = 0; i < kRows; ++i) {
+            for (unsigned int j = 0; j < kCols; ++j) {
+                /* Values read only by zero weights may lie outside the
+                   source */
+                float *dst = unrolled.row(i*kCols+j).data();
+                const int c = c0+j;
+                for (unsigned int y = 0; y < extRows; ++y, dst += extCols) {
+                    const int r = r0+y0+y+i;
+                    const int valid = r < src.rows ?
+                        std::max(std::min((int)extCols, src.cols-c), 0) : 0;
+                    if (valid > 0) {
+                        memcpy(dst, src.ptr< float >(r)+c,
+                               valid*sizeof(float));
+                    }
+                    std::fill(dst+valid, dst+extCols, 0.0f);
+                }
+            }
+        }
+        responses.noalias() = weights*unrolled;
+
+        for (unsigned int k = 0; k < kernels.size(); ++k) {
+            const float *resp = responses.row(k).data()+
+                (kernels[k].row-r0)*extCols+kernels[k].col-c0;
+            for (unsigned int y = y0; y < y1; ++y, resp += extCols) {
+                memcpy(kernels[k].dst+(size_t)y*cols, resp,
+                       cols*sizeof(float));
+            }
+        }
+    }
+}
+
+static void
+correlateFFT(const cv::Mat &src,
+             const unsigned int rows,
+             const unsigned int cols,
+             const std::vector< convKernel > &kernels)
+{
+    unsigned int r0 = UINT_MAX;
+    unsigned int c0 = UINT_MAX;
+    unsigned int r1 = 0;
+    unsigned int c1 = 0;
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        r0 = std::min(r0, kernels[k].row);
+        c0 = std::min(c0, kernels[k].col);
+        r1 = std::max(r1, kernels[k].row+kernels[k].weights.rows);
+        c1 = std::max(c1, kernels[k].col+kernels[k].weights.cols);
+    }
+
+    /* The window read by the kernels is transformed once; padding it to
+       the size of the spectra keeps the correlation from wrapping */
+    const int winRows = r1-r0+rows-1;
+    const int winCols = c1-c0+cols-1;
+    const int dftRows = cv::getOptimalDFTSize(winRows);
+    const int dftCols = cv::getOptimalDFTSize(winCols);
+    cv::Mat padded = cv::Mat::zeros(dftRows, dftCols, CV_32FC1);
+    cv::Mat window = padded(cv::Rect(0, 0, winCols, winRows));
+    src(cv::Rect(c0, r0, winCols, winRows)).copyTo(window);
+    cv::Mat srcSpectrum;
+    cv::dft(padded, srcSpectrum, 0, winRows);
+
+    cv::Mat kernelSpectrum;
+    cv::Mat product;
+    cv::Mat response;
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        const convKernel &kernel = kernels[k];
+        const cv::Rect place(kernel.col-c0, kernel.row-r0,
+                             kernel.weights.cols, kernel.weights.rows);
+        padded.setTo(0);
+        cv::Mat placed = padded(place);
+        kernel.weights.copyTo(placed);
+        cv::dft(padded, kernelSpectrum, 0, place.y+place.height);
+
+        /* Multiplying by the conjugate of the kernel spectrum turns the
+           convolution into a correlation */
+        cv::mulSpectrums(srcSpectrum, kernelSpectrum, product, 0, true);
+        cv::dft(product, response,
+                cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, rows);
+        cv::Mat dst(rows, cols, CV_32FC1, kernel.dst);
+        response(cv::Rect(0, 0, cols, rows)).copyTo(dst);
+    }
+}
+
+void
+correlateKernels(const convEngine engine,
+                 const cv::Mat &src,
+                 const unsigned int rows,
+                 const unsigned int cols,
+                 const std::vector< convKernel > &kernels)
+{
+    assert(src.type() == CV_32FC1);
+    for (unsigned int k = 0; k < kernels.size(); ++k) {
+        assert(kernels[k].weights.type() == CV_32FC1);
+        assert(kernels[k].row+rows+kernels[k].weights.rows-1 <=
+               (unsigned int)src.rows);
+        assert(kernels[k].col+cols+kernels[k].weights.cols-1 <=
+               (unsigned int)src.cols);
+    }
+    if (kernels.empty() || rows == 0 || cols == 0) {
+        return;
+    }
+
+    switch (engine) {
+    case CONV_GEMM:
+        correlateGemm(src, rows, cols, kernels);
+        break;
+    case CONV_FFT:
+        correlateFFT(src, rows, cols, kernels);
+        break;
+    default:
+        correlateDirect(src, rows, cols, kernels);
+        break;
+    }
+}
+
+void
+correlateJobs(const std::vector< ImageBuffer > &channels,
+              const std::vector< convJob > &jobs)
+{
+    /* Batches are keyed by channel, kernel size (0 for separated kernels)
+       and output size */
+    typedef std::tuple< unsigned int, unsigned int,
+                        unsigned int, unsigned int > batchKey;
+    std::map< batchKey, std::vector< unsigned int > > batches;
+    for (unsigned int j = 0; j < jobs.size(); ++j) {
+        const convKernel &kernel = jobs[j].kernel;
+        const unsigned int size = kernel.colFactors.empty() ?
+            kernel.weights.rows : 0;
+        batches[batchKey(jobs[j].chNo, size,
+                         jobs[j].rows, jobs[j].cols)].push_back(j);
+    }
+
+    std::vector< convEngine > engines;
+    std::vector< unsigned int > taskJobs;
+    std::vector< std::vector< convKernel > > taskKernels;
+    std::map< batchKey, unsigned int > fftTasks;
+    for (auto it = batches.begin(); it != batches.end(); ++it) {
+        const std::vector< unsigned int > &batch = it->second;
+        const convJob &first = jobs[batch[0]];
+        const convEngine engine = std::get< 1 >(it->first) == 0 ?
+            CONV_DIRECT : selectConvEngine(std::get< 1 >(it->first),
+                                           batch.size(),
+                                           first.rows, first.cols);
+        const batchKey fftKey(first.chNo, 0, first.rows, first.cols);
+        for (unsigned int i = 0; i < batch.size(); ++i) {
+            const convKernel &kernel = jobs[batch[i]].kernel;
+            if (engine == CONV_FFT && fftTasks.count(fftKey) > 0) {
+                taskKernels[fftTasks[fftKey]].push_back(kernel);
+                continue;
+            }
+            if (engine == CONV_FFT) {
+                fftTasks[fftKey] = engines.size();
+            } else if (engine == CONV_GEMM && i > 0) {
+                taskKernels.back().push_back(kernel);
+                continue;
+            }
+            engines.push_back(engine);
+            taskJobs.push_back(batch[i]);
+            taskKernels.push_back(std::vector< convKernel >(1, kernel));
+        }
+    }
+
+    parallelFor(engines.size(), [&](unsigned int t) {
+        const convJob &job = jobs[taskJobs[t]];
+        correlateKernels(engines[t], channels[job.chNo].mat(),
+                         job.rows, job.cols, taskKernels[t]);
+    });
+}
+
+const char *
+getConvEngineName(const convEngine engine)
+{
+    switch (engine) {
+    case CONV_GEMM:
+        return "im2col+GEMM";
+    case CONV_FFT:
+        return "FFT";
+    default:
+        return "direct";
+    }
+}
+
+/**
+ * struct convCalibration - Fastest engine for each of the calibration
+ *                          batches
+ */
+typedef struct convCalibration {
+    convEngine fastest[CALIBRATION_SIZES_NO][CALIBRATION_COUNTS_NO]
+        [CALIBRATION_SIDES_NO];
+
+    convCalibration()
+    {
+        std::chrono::time_point< std::chrono::steady_clock > start =
+            std::chrono::steady_clock::now();
+        std::mt19937 rng(0);
+        std::uniform_real_distribution< float > values(-1, 1);
+
+        for (unsigned int sd = 0; sd < CALIBRATION_SIDES_NO; ++sd) {
+            const unsigned int side = CALIBRATION_SIDES[sd];
+            const unsigned int srcSide = side+CALIBRATION_PATCH;
+            cv::Mat src(srcSide, srcSide, CV_32FC1);
+            for (unsigned int r = 0; r < srcSide; ++r) {
+                float *row = src.ptr< float >(r);
+                for (unsigned int c = 0; c < srcSide; ++c) {
+                    row[c] = values(rng);
+                }
+            }
+            std::vector< float > out(CALIBRATION_COUNTS[
+                                         CALIBRATION_COUNTS_NO-1]*
+                                     side*side);
+
+            for (unsigned int s = 0; s < CALIBRATION_SIZES_NO; ++s) {
+                const unsigned int size = CALIBRATION_SIZES[s];
+                for (unsigned int n = 0; n < CALIBRATION_COUNTS_NO; ++n) {
+                    /* Kernels are scattered over a sample, as the learned
+                       filters are */
+                    std::vector< convKernel > kernels(CALIBRATION_COUNTS[n]);
+                    for (unsigned int k = 0; k < kernels.size(); ++k) {
+                        kernels[k].weights.create(size, size, CV_32FC1);
+                        for (unsigned int r = 0; r < size; ++r) {
+                            for (unsigned int c = 0; c < size; ++c) {
+                                kernels[k].weights.at< float >(r, c) =
+                                    values(rng);
+                            }
+                        }
+                        kernels[k].row =
+                            rng() % (CALIBRATION_PATCH-size+1);
+                        kernels[k].col =
+                            rng() % (CALIBRATION_PATCH-size+1);
+                        kernels[k].dst = out.data()+k*side*side;
+                    }
+                    fastest[s][n][sd] = timeEngines(src, side, kernels);
+                }
+            }
+        }
+
+        std::chrono::duration< double > elapsed_s =
+            std::chrono::steady_clock::now()-start;
+        log_info("\tConvolution engines calibrated (took %.3fs)",
+                 elapsed_s.count());
+    };
+
+    /**
+     * timeEngines() - Find the fastest engine on a batch of kernels
+     *
+     * @src    : source image
+     * @side   : number of output rows and columns
+     * @kernels: kernels of the batch
+     *
+     * Return: fastest engine (best of two runs each)
+     */
+    static convEngine
+    timeEngines(const cv::Mat &src,
+                const unsigned int side,
+                const std::vector< convKernel > &kernels)
+    {
+        convEngine best = CONV_DIRECT;
+        double bestTime = 0;
+        for (int e = 0; e < CONV_ENGINES_NO; ++e) {
+            double time = 0;
+            for (unsigned int run = 0; run < 2; ++run) {
+                std::chrono::time_point< std::chrono::steady_clock > start =
+                    std::chrono::steady_clock::now();
+                correlateKernels((convEngine)e, src, side, side, kernels);
+                std::chrono::duration< double > elapsed_s =
+                    std::chrono::steady_clock::now()-start;
+                time = run == 0 ? elapsed_s.count() :
+                    std::min(time, elapsed_s.count());
+            }
+            if (e == CONV_DIRECT || time < bestTime) {
+                best = (convEngine)e;
+                bestTime = time;
+            }
+        }
+        return best;
+    }
+} convCalibration;
+
+/* Built at the first use (thread-safe since C++11) */
+static const convCalibration &
+getCalibration()
+{
+    static const convCalibration calibration;
+    return calibration;
+}
+
+/**
+ * nearestIndex() - Get the index of the calibrated value closest to a value,
+ *                  in ratio
+ *
+ * @calibrated: calibrated values, in increasing order
+ * @n         : number of calibrated values
+ * @value     : sought value
+ *
+ * Return: index of the closest calibrated value
+ */
+static unsigned int
+nearestIndex(const unsigned int *calibrated,
+             const unsigned int n,
+             const double value)
+{
+    unsigned int best = 0;
+    for (unsigned int i = 1; i < n; ++i) {
+        if (std::abs(std::log(value/calibrated[i])) <
+            std::abs(std::log(value/calibrated[best]))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+convEngine
+selectConvEngine(const unsigned int kernelSize,
+                 const unsigned int kernelsNo,
+                 const unsigned int rows,
+                 const unsigned int cols)
+{
+    const convCalibration &calibration = getCalibration();
+    const unsigned int s = nearestIndex(CALIBRATION_SIZES,
+                                        CALIBRATION_SIZES_NO,
+                                        std::max(kernelSize, 1U));
+    const unsigned int n = nearestIndex(CALIBRATION_COUNTS,
+                                        CALIBRATION_COUNTS_NO,
+                                        std::max(kernelsNo, 1U));
+    const unsigned int sd = nearestIndex(CALIBRATION_SIDES,
+                                         CALIBRATION_SIDES_NO,
+                                         std::sqrt((double)rows*cols+1));
+    return calibration.fastest[s][n][sd];
+}
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef CONVOLUTION_HPP_
+#define CONVOLUTION_HPP_
+
+#include <vector>
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include <opencv2/opencv.hpp>
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+#include "ImageBuffer.hpp"
+
+/* Ways of applying a batch of kernels to the same source image */
+enum convEngine {
+    CONV_DIRECT = 0,
+    CONV_GEMM,
+    CONV_FFT,
+    CONV_ENGINES_NO
+};
+
+/**
+ * struct convKernel - Kernel correlated with a source image
+ *
+ * @weights   : kernel weights (CV_32FC1)
+ * @colFactors: column factors of the separable terms of the kernel, one per
+ *              row (CV_32FC1, empty if the kernel is not separated)
+ * @rowFactors: row factors of the separable terms of the kernel, one per row
+ *              (CV_32FC1, empty if the kernel is not separated)
+ * @row       : row of the source read by the top-left weight for the first
+ *              output row
+ * @col       : column of the source read by the top-left weight for the
+ *              first output column
+ * @dst       : output values, stored row after row without padding
+ *
+ * The direct engine applies separated kernels term by term, with a pass on
+ * the rows followed by one on the columns; the other engines use weights,
+ * which has to hold the sum of the terms.
+ */
+typedef struct convKernel {
+    cv::Mat weights;
+    cv::Mat colFactors;
+    cv::Mat rowFactors;
+    unsigned int row;
+    unsigned int col;
+    float *dst;
+} convKernel;
+
+/**
+ * struct convJob - Kernel applied to one of the channels of an image
+ *
+ * @chNo  : channel read by the kernel
+ * @rows  : number of output rows
+ * @cols  : number of output columns
+ * @kernel: kernel to apply, along with its output
+ */
+typedef struct convJob {
+    unsigned int chNo;
+    unsigned int rows;
+    unsigned int cols;
+    convKernel kernel;
+} convJob;
+
+/**
+ * getConvEngineName() - Get a printable name for a convolution engine
+ *
+ * @engine: considered engine
+ *
+ * Return: name of the engine
+ */
+const char *getConvEngineName(const convEngine engine);
+
+/**
+ * selectConvEngine() - Get the fastest engine for a batch of kernels,
+ *                      according to a calibration table built once (at
+ *                      the first call) by timing the engines
+ *
+ * @kernelSize: side of the kernels
+ * @kernelsNo : number of kernels sharing the same source
+ * @rows      : number of output rows
+ * @cols      : number of output columns
+ *
+ * Return: fastest engine among the calibrated ones closest to the batch
+ */
+convEngine selectConvEngine(const unsigned int kernelSize,
+                            const unsigned int kernelsNo,
+                            const unsigned int rows,
+                            const unsigned int cols);
+
+/**
+ * correlateKernels() - Correlate a set of kernels with the same source,
+ *                      each of them writing rows*cols values
+ *
+ * @engine : engine used to compute the responses
+ * @src    : source image (CV_32FC1), which has to hold all the values read
+ *           by the kernels
+ * @rows   : number of output rows
+ * @cols   : number of output columns
+ * @kernels: kernels to apply, along with their outputs
+ *
+ * Output (y, x) of a kernel is the sum of weights(i, j) times
+ * src(row+y+i, col+x+j). The responses are computed on the calling thread.
+ */
+void correlateKernels(const convEngine engine,
+                      const cv::Mat &src,
+                      const unsigned int rows,
+                      const unsigned int cols,
+                      const std::vector< convKernel > &kernels);
+
+/**
+ * correlateJobs() - Apply a set of kernels to the channels of an image, in
+ *                   parallel, each batch of kernels on the engine found to
+ *                   be the fastest for it
+ *
+ * @channels: channels of the image (CV_32FC1)
+ * @jobs    : kernels to apply, along with their channels and outputs
+ *
+ * Kernels reading the same channel, with the same size and output size,
+ * form a batch. FFT batches sharing a channel and an output size are merged
+ * to transform the channel once, direct ones are split to balance the load,
+ * and separated kernels are applied on their own by the direct engine.
+ */
+void correlateJobs(const std::vector< ImageBuffer > &channels,
+                   const std::vector< convJob > &jobs);
+
+#endif /* CONVOLUTION_HPP_ */
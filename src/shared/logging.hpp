@@ -41,8 +41,7 @@ extern "C" {
 #ifdef INFO_MSG
 #define log_info(M, ...)                                \
     do {                                                \
-        fprintf(stderr, "[INFO] ");                     \
-        fprintf(stderr, M "\n", ##__VA_ARGS__);         \
+        fprintf(stderr, "[INFO] " M "\n", ##__VA_ARGS__);  \
     } while (0);
 #else // !INFO_MSG
 #define log_info(M, ...)
@@ -0,0 +1,165 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include <Eigen/Core>
+#include <unsupported/Eigen/CXX11/ThreadPool>
+#pragma GCC diagnostic pop
+
+#include "scheduler.hpp"
+
+/**
+ * struct loopState - State of a parallel loop, shared by its caller and the
+ *                    tasks helping it
+ *
+ * @next : first iteration not claimed yet
+ * @done : number of iterations completed
+ * @n    : number of iterations
+ * @grain: number of consecutive iterations claimed at once
+ * @body : function run on each iteration (only valid while some iterations
+ *         are not completed)
+ * @lock : lock protecting error and the completion notification
+ * @over : notified when the last iteration is completed
+ * @error: first exception thrown by an iteration
+ */
+typedef struct loopState {
+    std::atomic< size_t > next;
+    std::atomic< unsigned int > done;
+    unsigned int n;
+    unsigned int grain;
+    const std::function< void(unsigned int) > *body;
+    std::mutex lock;
+    std::condition_variable over;
+    std::exception_ptr error;
+} loopState;
+
+static std::mutex schedulerLock;
+static std::unique_ptr< Eigen::NonBlockingThreadPool > pool;
+static unsigned int threadsNo = 0;
+
+void
+initScheduler(const unsigned int threads)
+{
+    std::lock_guard< std::mutex > guard(schedulerLock);
+    threadsNo = threads > 0 ? threads :
+        std::max(std::thread::hardware_concurrency(), 1U);
+
+    /* The caller of a loop runs iterations as well: it counts as one of
+       the threads */
+    pool.reset(threadsNo > 1 ?
+               new Eigen::NonBlockingThreadPool(threadsNo-1) : nullptr);
+    cv::setNumThreads(1);
+    Eigen::setNbThreads(1);
+}
+
+static Eigen::NonBlockingThreadPool *
+getPool()
+{
+    {
+        std::lock_guard< std::mutex > guard(schedulerLock);
+        if (threadsNo > 0) {
+            return pool.get();
+        }
+    }
+    initScheduler(0);
+    return pool.get();
+}
+
+unsigned int
+getSchedulerThreadsNo()
+{
+    getPool();
+    return threadsNo;
+}
+
+static void
+runIterations(loopState &state)
+{
+    while (true) {
+        const size_t first = state.next.fetch_add(state.grain);
+        if (first >= state.n) {
+            return;
+        }
+        const unsigned int last = std::min(first+state.grain,
+                                           (size_t)state.n);
+        try {
+            for (unsigned int i = first; i < last; ++i) {
+                (*state.body)(i);
+            }
+        } catch (...) {
+            std::lock_guard< std::mutex > guard(state.lock);
+            if (!state.error) {
+                state.error = std::current_exception();
+            }
+        }
+        const unsigned int count = last-first;
+        if (state.done.fetch_add(count)+count == state.n) {
+            std::lock_guard< std::mutex > guard(state.lock);
+            state.over.notify_all();
+        }
+    }
+}
+
+void
+parallelFor(const unsigned int n,
+            const std::function< void(unsigned int) > &body,
+            const unsigned int maxWorkers,
+            const unsigned int grain)
+{
+    if (n == 0) {
+        return;
+    }
+
+    std::shared_ptr< loopState > state = std::make_shared< loopState >();
+    state->next = 0;
+    state->done = 0;
+    state->n = n;
+    state->grain = std::max(grain, 1U);
+    state->body = &body;
+
+    /* Helpers left in the queue once all the iterations are claimed find
+       nothing to do: only the claimed iterations are waited for */
+    Eigen::NonBlockingThreadPool *threads = getPool();
+    const unsigned int chunksNo = (n+state->grain-1)/state->grain;
+    unsigned int helpersNo = threads != nullptr ? threads->NumThreads() : 0;
+    helpersNo = std::min(helpersNo, chunksNo-1);
+    if (maxWorkers > 0) {
+        helpersNo = std::min(helpersNo, maxWorkers-1);
+    }
+    for (unsigned int i = 0; i < helpersNo; ++i) {
+        threads->Schedule([state]() { runIterations(*state); });
+    }
+    runIterations(*state);
+
+    std::unique_lock< std::mutex > guard(state->lock);
+    state->over.wait(guard, [&state]() { return state->done == state->n; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
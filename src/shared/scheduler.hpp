@@ -0,0 +1,64 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef SCHEDULER_HPP_
+#define SCHEDULER_HPP_
+
+#include <functional>
+
+/**
+ * initScheduler() - Create the threads shared by all the parallel loops
+ *
+ * @threadsNo: overall number of threads (0 to use all the hardware ones)
+ *
+ * The budget covers the scheduler, OpenCV and Eigen: the loops run as tasks
+ * of a single work-stealing pool, so OpenCV and Eigen are restricted to one
+ * thread per call. Has to be called before the first parallel loop, which
+ * otherwise initializes the scheduler with all the hardware threads.
+ */
+void initScheduler(const unsigned int threadsNo);
+
+/**
+ * getSchedulerThreadsNo() - Get the overall number of threads used by the
+ *                           scheduler (the caller of a loop included)
+ *
+ * Return: number of threads
+ */
+unsigned int getSchedulerThreadsNo();
+
+/**
+ * parallelFor() - Run the iterations of a loop as tasks of the scheduler
+ *
+ * @n         : number of iterations
+ * @body      : function run on each iteration, given its index
+ * @maxWorkers: maximum number of iterations run at the same time (0 for no
+ *              limit other than the threads number)
+ * @grain     : number of consecutive iterations claimed at once
+ *
+ * Iterations are claimed in order, and the caller runs them too: loops can
+ * be nested within the iterations of other loops, the idle threads picking
+ * up the iterations of whichever loop is still running. The first exception
+ * thrown by an iteration is rethrown to the caller once the loop is over.
+ */
+void parallelFor(const unsigned int n,
+                 const std::function< void(unsigned int) > &body,
+                 const unsigned int maxWorkers = 0,
+                 const unsigned int grain = 1);
+
+#endif /* SCHEDULER_HPP_ */
@@ -0,0 +1,535 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#include <cstring>
+
+#include "simd.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The scalar kernels are always available; the vectorized ones are compiled
+ * for their target extension only, and selected at runtime according to the
+ * running CPU, so that the binary still runs on machines without them.
+ */
+
+static float
+dotF32Scalar(const float *src, const float *w, const unsigned int n)
+{
+    float acc = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        acc += src[i]*w[i];
+    }
+    return acc;
+}
+
+static float
+dotF16Scalar(const Eigen::half *src, const float *w, const unsigned int n)
+{
+    float acc = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        acc += (float)src[i]*w[i];
+    }
+    return acc;
+}
+
+static float
+dotU8Scalar(const unsigned char *src, const float *w, const unsigned int n)
+{
+    float acc = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        acc += src[i]*w[i];
+    }
+    return acc;
+}
+
+static void
+expandF16Scalar(const Eigen::half *src, const unsigned int n, float *dst)
+{
+    for (unsigned int i = 0; i < n; ++i) {
+        dst[i] = (float)src[i];
+    }
+}
+
+static void
+expandU8Scalar(const unsigned char *src, const unsigned int n,
+               const float scale, const float offset, float *dst)
+{
+    for (unsigned int i = 0; i < n; ++i) {
+        dst[i] = src[i]*scale+offset;
+    }
+}
+
+static void
+momentsF32Scalar(const float *src, const unsigned int n,
+                 float &sum, float &sumSq)
+{
+    sum = 0;
+    sumSq = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        sum += src[i];
+        sumSq += src[i]*src[i];
+    }
+}
+
+static void
+scaleShiftF32Scalar(const float *src, const unsigned int n,
+                    const float scale, const float shift, float *dst)
+{
+    for (unsigned int i = 0; i < n; ++i) {
+        dst[i] = src[i]*scale+shift;
+    }
+}
+
+static void
+lbpRowScalar(const float *prev, const float *curr, const float *next,
+             const unsigned int n, unsigned char *codes)
+{
+    for (unsigned int j = 1; j <= n; ++j) {
+        const float center = curr[j];
+        unsigned char code = 0;
+        code |= (prev[j-1] > center) << 7;
+        code |= (prev[j] > center) << 6;
+        code |= (prev[j+1] > center) << 5;
+        code |= (curr[j+1] > center) << 4;
+        code |= (next[j+1] > center) << 3;
+        code |= (next[j] > center) << 2;
+        code |= (next[j-1] > center) << 1;
+        code |= (curr[j-1] > center) << 0;
+        codes[j-1] = code;
+    }
+}
+
+static unsigned int
+findZeroU8Scalar(const unsigned char *src, const unsigned int n,
+                 const bool zero)
+{
+    unsigned int i = 0;
+    while (i < n && (src[i] == 0) != zero) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef SIMD_X86
+#define SSE4_TARGET __attribute__((target("sse4.1")))
+
+/* Bit of a neighbour in the code, set where the neighbour is greater */
+#define SSE4_LBP_BIT(n, c, bit)                                         \
+    _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(n), c)),  \
+                  _mm_set1_epi32(1 << (bit)))
+
+SSE4_TARGET static void
+lbpRowSSE4(const float *prev, const float *curr, const float *next,
+           const unsigned int n, unsigned char *codes)
+{
+    unsigned int j = 1;
+    for (; j+4 <= n+1; j += 4) {
+        const __m128 c = _mm_loadu_ps(curr+j);
+        __m128i code = SSE4_LBP_BIT(prev+j-1, c, 7);
+        code = _mm_or_si128(code, SSE4_LBP_BIT(prev+j, c, 6));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(prev+j+1, c, 5));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(curr+j+1, c, 4));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(next+j+1, c, 3));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(next+j, c, 2));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(next+j-1, c, 1));
+        code = _mm_or_si128(code, SSE4_LBP_BIT(curr+j-1, c, 0));
+        /* Narrow the four 32-bit codes to bytes */
+        code = _mm_packus_epi32(code, code);
+        code = _mm_packus_epi16(code, code);
+        const int packed = _mm_cvtsi128_si32(code);
+        std::memcpy(codes+j-1, &packed, 4);
+    }
+    lbpRowScalar(prev+j-1, curr+j-1, next+j-1, n+1-j, codes+j-1);
+}
+
+SSE4_TARGET static unsigned int
+findZeroU8SSE4(const unsigned char *src, const unsigned int n,
+               const bool zero)
+{
+    /* Bits of the bytes that are zero, flipped when looking for nonzero */
+    const unsigned int flip = zero ? 0 : 0xFFFF;
+    unsigned int i = 0;
+    for (; i+16 <= n; i += 16) {
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast< const __m128i * >(src+i));
+        const unsigned int found =
+            (unsigned int)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(v, _mm_setzero_si128())) ^ flip;
+        if (found != 0) {
+            return i+(unsigned int)__builtin_ctz(found);
+        }
+    }
+    return i+findZeroU8Scalar(src+i, n-i, zero);
+}
+
+/* The AVX2 kernels convert halves with F16C, which the dispatcher checks
+   along with AVX2 and FMA */
+#define AVX2_TARGET __attribute__((target("avx2,fma,f16c")))
+
+AVX2_TARGET static inline float
+hsumAVX2(const __m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+AVX2_TARGET static float
+dotF32AVX2(const float *src, const float *w, const unsigned int n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(src+i),
+                              _mm256_loadu_ps(w+i), acc);
+    }
+    return hsumAVX2(acc)+dotF32Scalar(src+i, w+i, n-i);
+}
+
+AVX2_TARGET static float
+dotF16AVX2(const Eigen::half *src, const float *w, const unsigned int n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        const __m256 v = _mm256_cvtph_ps(
+            _mm_loadu_si128(reinterpret_cast< const __m128i * >(src+i)));
+        acc = _mm256_fmadd_ps(v, _mm256_loadu_ps(w+i), acc);
+    }
+    return hsumAVX2(acc)+dotF16Scalar(src+i, w+i, n-i);
+}
+
+AVX2_TARGET static float
+dotU8AVX2(const unsigned char *src, const float *w, const unsigned int n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        const __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast< const __m128i * >(src+i))));
+        acc = _mm256_fmadd_ps(v, _mm256_loadu_ps(w+i), acc);
+    }
+    return hsumAVX2(acc)+dotU8Scalar(src+i, w+i, n-i);
+}
+
+AVX2_TARGET static void
+expandF16AVX2(const Eigen::half *src, const unsigned int n, float *dst)
+{
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        _mm256_storeu_ps(dst+i, _mm256_cvtph_ps(
+            _mm_loadu_si128(reinterpret_cast< const __m128i * >(src+i))));
+    }
+    expandF16Scalar(src+i, n-i, dst+i);
+}
+
+AVX2_TARGET static void
+expandU8AVX2(const unsigned char *src, const unsigned int n,
+             const float scale, const float offset, float *dst)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 o = _mm256_set1_ps(offset);
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        const __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast< const __m128i * >(src+i))));
+        _mm256_storeu_ps(dst+i, _mm256_fmadd_ps(v, s, o));
+    }
+    expandU8Scalar(src+i, n-i, scale, offset, dst+i);
+}
+AVX2_TARGET static void
+momentsF32AVX2(const float *src, const unsigned int n,
+               float &sum, float &sumSq)
+{
+    __m256 s = _mm256_setzero_ps();
+    __m256 sq = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(src+i);
+        s = _mm256_add_ps(s, v);
+        sq = _mm256_fmadd_ps(v, v, sq);
+    }
+    momentsF32Scalar(src+i, n-i, sum, sumSq);
+    sum += hsumAVX2(s);
+    sumSq += hsumAVX2(sq);
+}
+
+AVX2_TARGET static void
+scaleShiftF32AVX2(const float *src, const unsigned int n,
+                  const float scale, const float shift, float *dst)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 o = _mm256_set1_ps(shift);
+    unsigned int i = 0;
+    for (; i+8 <= n; i += 8) {
+        _mm256_storeu_ps(dst+i,
+                         _mm256_fmadd_ps(_mm256_loadu_ps(src+i), s, o));
+    }
+    scaleShiftF32Scalar(src+i, n-i, scale, shift, dst+i);
+}
+
+#define AVX2_LBP_BIT(n, c, bit)                                         \
+    _mm256_and_si256(_mm256_castps_si256(                               \
+                         _mm256_cmp_ps(_mm256_loadu_ps(n), c, _CMP_GT_OQ)), \
+                     _mm256_set1_epi32(1 << (bit)))
+
+AVX2_TARGET static void
+lbpRowAVX2(const float *prev, const float *curr, const float *next,
+           const unsigned int n, unsigned char *codes)
+{
+    unsigned int j = 1;
+    for (; j+8 <= n+1; j += 8) {
+        const __m256 c = _mm256_loadu_ps(curr+j);
+        __m256i code = AVX2_LBP_BIT(prev+j-1, c, 7);
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(prev+j, c, 6));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(prev+j+1, c, 5));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(curr+j+1, c, 4));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(next+j+1, c, 3));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(next+j, c, 2));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(next+j-1, c, 1));
+        code = _mm256_or_si256(code, AVX2_LBP_BIT(curr+j-1, c, 0));
+        /* Narrow the eight 32-bit codes to bytes: packing works within
+           each 128-bit lane, leaving four codes at the bottom of each */
+        code = _mm256_packus_epi32(code, code);
+        code = _mm256_packus_epi16(code, code);
+        const int lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(code));
+        const int hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(code, 1));
+        std::memcpy(codes+j-1, &lo, 4);
+        std::memcpy(codes+j+3, &hi, 4);
+    }
+    lbpRowScalar(prev+j-1, curr+j-1, next+j-1, n+1-j, codes+j-1);
+}
+
+AVX2_TARGET static unsigned int
+findZeroU8AVX2(const unsigned char *src, const unsigned int n,
+               const bool zero)
+{
+    const unsigned int flip = zero ? 0 : 0xFFFFFFFFu;
+    unsigned int i = 0;
+    for (; i+32 <= n; i += 32) {
+        const __m256i v =
+            _mm256_loadu_si256(reinterpret_cast< const __m256i * >(src+i));
+        const unsigned int found =
+            (unsigned int)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(v, _mm256_setzero_si256())) ^ flip;
+        if (found != 0) {
+            return i+(unsigned int)__builtin_ctz(found);
+        }
+    }
+    return i+findZeroU8Scalar(src+i, n-i, zero);
+}
+
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+AVX512_TARGET static inline float
+hsumAVX512(const __m512 v)
+{
+    /* Only called once per segment: going through memory is cheap enough,
+       and avoids the lane shuffles */
+    float lanes[16];
+    _mm512_storeu_ps(lanes, v);
+    float acc = 0;
+    for (unsigned int i = 0; i < 16; ++i) {
+        acc += lanes[i];
+    }
+    return acc;
+}
+
+AVX512_TARGET static void
+momentsF32AVX512(const float *src, const unsigned int n,
+                 float &sum, float &sumSq)
+{
+    __m512 s = _mm512_setzero_ps();
+    __m512 sq = _mm512_setzero_ps();
+    unsigned int i = 0;
+    for (; i+16 <= n; i += 16) {
+        const __m512 v = _mm512_loadu_ps(src+i);
+        s = _mm512_add_ps(s, v);
+        sq = _mm512_fmadd_ps(v, v, sq);
+    }
+    momentsF32Scalar(src+i, n-i, sum, sumSq);
+    sum += hsumAVX512(s);
+    sumSq += hsumAVX512(sq);
+}
+
+AVX512_TARGET static void
+scaleShiftF32AVX512(const float *src, const unsigned int n,
+                    const float scale, const float shift, float *dst)
+{
+    const __m512 s = _mm512_set1_ps(scale);
+    const __m512 o = _mm512_set1_ps(shift);
+    unsigned int i = 0;
+    for (; i+16 <= n; i += 16) {
+        _mm512_storeu_ps(dst+i,
+                         _mm512_fmadd_ps(_mm512_loadu_ps(src+i), s, o));
+    }
+    scaleShiftF32Scalar(src+i, n-i, scale, shift, dst+i);
+}
+#endif // SIMD_X86
+
+/**
+ * struct simdKernels - Kernels selected for the running CPU
+ */
+typedef struct simdKernels {
+    simdLevel level;
+    float (*dotF32)(const float *, const float *, const unsigned int);
+    float (*dotF16)(const Eigen::half *, const float *, const unsigned int);
+    float (*dotU8)(const unsigned char *, const float *, const unsigned int);
+    void (*expandF16)(const Eigen::half *, const unsigned int, float *);
+    void (*expandU8)(const unsigned char *, const unsigned int,
+                     const float, const float, float *);
+    void (*momentsF32)(const float *, const unsigned int, float &, float &);
+    void (*scaleShiftF32)(const float *, const unsigned int,
+                          const float, const float, float *);
+    void (*lbpRow)(const float *, const float *, const float *,
+                   const unsigned int, unsigned char *);
+    unsigned int (*findZeroU8)(const unsigned char *, const unsigned int,
+                               const bool);
+
+    /* Each level keeps the kernels of the lower ones it does not
+       override: SSE4.1 only brings LBP and the byte search, and AVX-512
+       only the moments and the scale/shift, the other kernels running
+       their AVX2 versions */
+    simdKernels() :
+        level(SIMD_SCALAR),
+        dotF32(dotF32Scalar), dotF16(dotF16Scalar), dotU8(dotU8Scalar),
+        expandF16(expandF16Scalar), expandU8(expandU8Scalar),
+        momentsF32(momentsF32Scalar), scaleShiftF32(scaleShiftF32Scalar),
+        lbpRow(lbpRowScalar), findZeroU8(findZeroU8Scalar)
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) {
+            level = SIMD_SSE4;
+            lbpRow = lbpRowSSE4;
+            findZeroU8 = findZeroU8SSE4;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+            __builtin_cpu_supports("f16c")) {
+            level = SIMD_AVX2;
+            dotF32 = dotF32AVX2;
+            dotF16 = dotF16AVX2;
+            dotU8 = dotU8AVX2;
+            expandF16 = expandF16AVX2;
+            expandU8 = expandU8AVX2;
+            momentsF32 = momentsF32AVX2;
+            scaleShiftF32 = scaleShiftF32AVX2;
+            lbpRow = lbpRowAVX2;
+            findZeroU8 = findZeroU8AVX2;
+        }
+        if (level == SIMD_AVX2 && __builtin_cpu_supports("avx512f")) {
+            level = SIMD_AVX512;
+            momentsF32 = momentsF32AVX512;
+            scaleShiftF32 = scaleShiftF32AVX512;
+        }
+#endif // SIMD_X86
+    };
+} simdKernels;
+
+/* Initialized at the first use (thread-safe since C++11) */
+static const simdKernels &
+getKernels()
+{
+    static const simdKernels kernels;
+    return kernels;
+}
+
+simdLevel
+getSimdLevel()
+{
+    return getKernels().level;
+}
+
+const char *
+getSimdLevelName(const simdLevel level)
+{
+    switch (level) {
+    case SIMD_SSE4:
+        return "SSE4.1";
+    case SIMD_AVX2:
+        return "AVX2";
+    case SIMD_AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+float
+dotF32(const float *src, const float *w, const unsigned int n)
+{
+    return getKernels().dotF32(src, w, n);
+}
+
+float
+dotF16(const Eigen::half *src, const float *w, const unsigned int n)
+{
+    return getKernels().dotF16(src, w, n);
+}
+
+float
+dotU8(const unsigned char *src, const float *w, const unsigned int n)
+{
+    return getKernels().dotU8(src, w, n);
+}
+
+void
+expandF16(const Eigen::half *src, const unsigned int n, float *dst)
+{
+    getKernels().expandF16(src, n, dst);
+}
+
+void
+expandU8(const unsigned char *src, const unsigned int n,
+         const float scale, const float offset, float *dst)
+{
+    getKernels().expandU8(src, n, scale, offset, dst);
+}
+
+void
+momentsF32(const float *src, const unsigned int n, float &sum, float &sumSq)
+{
+    getKernels().momentsF32(src, n, sum, sumSq);
+}
+
+void
+scaleShiftF32(const float *src, const unsigned int n,
+              const float scale, const float shift, float *dst)
+{
+    getKernels().scaleShiftF32(src, n, scale, shift, dst);
+}
+
+void
+lbpRow(const float *prev, const float *curr, const float *next,
+       const unsigned int n, unsigned char *codes)
+{
+    getKernels().lbpRow(prev, curr, next, n, codes);
+}
+
+unsigned int
+findZeroU8(const unsigned char *src, const unsigned int n, const bool zero)
+{
+    return getKernels().findZeroU8(src, n, zero);
+}
@@ -0,0 +1,158 @@
+/*******************************************************************************
+ ** MOVABLE project - REDS Institute, HEIG-VD, Yverdon-les-Bains (CH) - 2016  **
+ **                                                                           **
+ ** This file is part of MOVABLE.                                             **
+ **                                                                           **
+ **  MOVABLE is free software: you can redistribute it and/or modify          **
+ **  it under the terms of the GNU General Public License as published by     **
+ **  the Free Software Foundation, either version 3 of the License, or        **
+ **  (at your option) any later version.                                      **
+ **                                                                           **
+ **  MOVABLE is distributed in the hope that it will be useful,               **
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of           **
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            **
+ **  GNU General Public License for more details.                             **
+ **                                                                           **
+ **  You should have received a copy of the GNU General Public License        **
+ **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
+ ******************************************************************************/
+
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#include <Eigen/Core>
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+/* Instruction set extensions the kernels can be dispatched to */
+enum simdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE4,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+/**
+ * getSimdLevel() - Get the widest instruction set extension supported by the
+ *                  running CPU (detected once, at the first call)
+ *
+ * Return: detected extension level
+ */
+simdLevel getSimdLevel();
+
+/**
+ * getSimdLevelName() - Get a printable name for an extension level
+ *
+ * @level: considered extension level
+ *
+ * Return: name of the level
+ */
+const char *getSimdLevelName(const simdLevel level);
+
+/**
+ * dotF32() - Compute the dot product of a float segment with a set of weights
+ *
+ * @src: source values
+ * @w  : weights
+ * @n  : number of values
+ *
+ * Return: dot product
+ */
+float dotF32(const float *src, const float *w, const unsigned int n);
+
+/**
+ * dotF16() - Compute the dot product of a half precision segment with a set
+ *            of weights
+ *
+ * @src: source values
+ * @w  : weights
+ * @n  : number of values
+ *
+ * Return: dot product
+ */
+float dotF16(const Eigen::half *src, const float *w, const unsigned int n);
+
+/**
+ * dotU8() - Compute the dot product of a segment of 8-bit codes with a set of
+ *           weights (the codes are taken as they are, without scale/offset)
+ *
+ * @src: source codes
+ * @w  : weights
+ * @n  : number of values
+ *
+ * Return: dot product
+ */
+float dotU8(const unsigned char *src, const float *w, const unsigned int n);
+
+/**
+ * expandF16() - Expand a half precision segment to float
+ *
+ * @src: source values
+ * @n  : number of values
+ * @dst: destination buffer (at least n values)
+ */
+void expandF16(const Eigen::half *src, const unsigned int n, float *dst);
+
+/**
+ * expandU8() - Expand a segment of 8-bit codes to float, as code*scale+offset
+ *
+ * @src   : source codes
+ * @n     : number of values
+ * @scale : scale applied to the codes
+ * @offset: offset added to the scaled codes
+ * @dst   : destination buffer (at least n values)
+ */
+void expandU8(const unsigned char *src, const unsigned int n,
+              const float scale, const float offset, float *dst);
+
+/**
+ * momentsF32() - Compute the sum and the sum of squares of a float segment
+ *
+ * @src  : source values
+ * @n    : number of values
+ * @sum  : output sum of the values
+ * @sumSq: output sum of the squared values
+ */
+void momentsF32(const float *src, const unsigned int n,
+                float &sum, float &sumSq);
+
+/**
+ * scaleShiftF32() - Scale and shift a float segment, as src*scale+shift
+ *
+ * @src  : source values
+ * @n    : number of values
+ * @scale: scale applied to the values
+ * @shift: value added to the scaled values
+ * @dst  : destination buffer (at least n values, can be src itself)
+ */
+void scaleShiftF32(const float *src, const unsigned int n,
+                   const float scale, const float shift, float *dst);
+
+/**
+ * lbpRow() - Compute the 8-neighbour LBP codes of a row
+ *
+ * @prev : row above, starting one column before the first center
+ * @curr : row of the centers, starting one column before the first center
+ * @next : row below, starting one column before the first center
+ * @n    : number of codes to compute (n+2 values are read from each row)
+ * @codes: output codes, one bit per neighbour greater than the center
+ *         (clockwise from the upper-left one, which is the MSB)
+ */
+void lbpRow(const float *prev, const float *curr, const float *next,
+            const unsigned int n, unsigned char *codes);
+
+/**
+ * findZeroU8() - Find the first zero (or nonzero) byte of a segment
+ *
+ * @src : source bytes
+ * @n   : number of bytes
+ * @zero: whether to look for a zero byte rather than a nonzero one
+ *
+ * Return: index of the first matching byte, n if there is none
+ */
+unsigned int findZeroU8(const unsigned char *src, const unsigned int n,
+                        const bool zero);
+
+#endif /* SIMD_HPP_ */
@@ -17,6 +17,7 @@
  **  along with MOVABLE.  If not, see <http://www.gnu.org/licenses/>.         **
  ******************************************************************************/
 
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <iomanip>
@@ -30,6 +31,7 @@
 
 #include "DataTypes.hpp"
 #include "Dataset.hpp"
+#include "ImageBuffer.hpp"
 #include "logging.hpp"
 #include "utils.hpp"
 
@@ -85,21 +87,21 @@ computeF1Score(const cv::Mat &scoreImage,
 }
 
 float
-computeMR(const EMat &img, const EMat &gt, const unsigned int borderSize)
+computeMR(const EMat &img, const ELabelMat &gt)
 {
     assert(img.rows() == gt.rows());
     assert(img.cols() == gt.cols());
 
     float err_count = 0;
-    for (unsigned int r = borderSize; r < img.rows()-borderSize; ++r) {
-        for (unsigned int c = borderSize; c < img.cols()-borderSize; ++c) {
+    for (unsigned int r = 0; r < img.rows(); ++r) {
+        for (unsigned int c = 0; c < img.cols(); ++c) {
             /* Put a threshold at 0 -- we can do much better! */
             if (img(r, c)*gt(r, c) < 0) {
                 err_count += 1;
             }
         }
     }
-    return err_count / ((img.rows()-2*borderSize)*(img.cols()-2*borderSize));
+    return err_count / (img.rows()*img.cols());
 }
 
 bool
@@ -119,24 +121,16 @@ cvMatEquals(const cv::Mat m1, const cv::Mat m2)
 }
 
 void
-normalizeImage(const EMat &resultImage, const int borderSize,
-               cv::Mat &scoreImage)
+normalizeImage(const EMat &resultImage, cv::Mat &scoreImage)
 {
-    /* Convert matrix in OpenCV format */
-    cv::Mat img(resultImage.rows(), resultImage.cols(), CV_32FC1);
-    cv::eigen2cv(resultImage, img);
-
-    /* Drop border */
-    scoreImage = img(cv::Range(borderSize, img.rows-borderSize),
-                     cv::Range(borderSize, img.cols-borderSize));
-
-    /* Normalize image in [-1, 1] */
+    /* Normalize image in [-1, 1], reading the matrix in place */
+    const cv::Mat img = ImageBuffer::view(resultImage).mat();
     double min, max;
     cv::minMaxLoc(img, &min, &max);
     if (max-min > 1e-4) {
-        img = 2*(img-min)/(max-min)-1;
+        img.convertTo(scoreImage, CV_32FC1, 2/(max-min), -2*min/(max-min)-1);
     } else {
-        img.setTo(cv::Scalar(0));
+        scoreImage = cv::Mat::zeros(img.rows, img.cols, CV_32FC1);
     }
 }
 
@@ -199,32 +193,44 @@ void
 saveClassifiedImage(const EMat &classResult,
                     const std::string &dirPath,
                     const std::string &imgName,
-                    const unsigned int borderSize)
+                    const EByteMat *mask)
 {
-    /* Convert matrix in OpenCV format */
-    cv::Mat img(classResult.rows(), classResult.cols(), CV_32FC1);
-    cv::eigen2cv(classResult, img);
-
-    /* Drop border */
-    img = img(cv::Range(borderSize, img.rows-borderSize),
-              cv::Range(borderSize, img.cols-borderSize));
+    /* Read the matrix in place */
+    saveClassifiedImage(ImageBuffer::view(classResult).mat(), dirPath,
+                        imgName, mask);
+}
 
-    /* Normalize image in [0, 255] */
+void
+saveClassifiedImage(const cv::Mat &src,
+                    const std::string &dirPath,
+                    const std::string &imgName,
+                    const EByteMat *mask)
+{
+    /* Normalize image in [0, 255]. Pixels outside the mask may have been
+       left unclassified: they do not take part in the normalization and
+       are saved as 0 */
+    cv::Mat c_mask;
+    if (mask != nullptr && mask->size() > 0) {
+        c_mask = cv::Mat(mask->rows(), mask->cols(), CV_8UC1,
+                         const_cast< unsigned char * >(mask->data()));
+    }
+    cv::Mat img;
     double min, max;
-    cv::minMaxLoc(img, &min, &max);
+    cv::minMaxLoc(src, &min, &max, NULL, NULL, c_mask);
     if (max-min > 1e-4) {
-        img = (img-min)/(max-min)*255;
+        src.convertTo(img, CV_32FC1, 255/(max-min), -255*min/(max-min));
     } else {
-        img.setTo(cv::Scalar(0));
+        img = cv::Mat::zeros(src.rows, src.cols, CV_32FC1);
+    }
+    if (!c_mask.empty()) {
+        img.setTo(cv::Scalar(0), c_mask == 0);
     }
     /* Save resulting image */
     std::string dstPath = dirPath + "/" + imgName;
     cv::imwrite(dstPath.c_str(), img);
 
     // /* Save the raw-format image too */
-    // EMat roi = classResult.block(borderSize, borderSize,
-    //                              classResult.rows()-2*borderSize,
-    //                              classResult.cols()-2*borderSize);
+    // const EMat &roi = classResult;
     // dstPath += std::string(".raw");
     // FILE *fp = fopen(dstPath.c_str(), "wb");
     // if (fp == NULL) {
@@ -282,19 +288,24 @@ saveOverlayedImage(const std::string &imageFName,
 
 void
 saveThresholdedImage(const cv::Mat &classResult,
-                     const EMat &mask,
+                     const EByteMat &mask,
                      const float threshold,
                      const std::string &dirPath,
                      const std::string &imgName,
-                     const std::pair< int, int >& originalSize,
-                     const unsigned int borderSize)
+                     const std::pair< int, int >& originalSize)
 {
     cv::Mat tmp;
 
-    /* Normalize image in [0..255] to apply threshold */
+    /* Mask viewed in place, it is already 8-bit */
+    const cv::Mat c_mask(mask.rows(), mask.cols(), CV_8UC1,
+                         const_cast< unsigned char * >(mask.data()));
+
+    /* Normalize image in [0..255] to apply threshold. Pixels outside the
+       mask may have been left unclassified, they are not taken into
+       account */
     double min, max;
     cv::Mat localResult = classResult;
-    cv::minMaxLoc(classResult, &min, &max);
+    cv::minMaxLoc(classResult, &min, &max, NULL, NULL, c_mask);
     if (max-min > 1e-4) {
         localResult = (localResult-min)/(max-min)*255;
     } else {
@@ -305,18 +316,11 @@ saveThresholdedImage(const cv::Mat &classResult,
     cv::threshold(classResult, tmp, threshold,
                   255, cv::THRESH_BINARY);
 
-    /* Apply mask */
-    cv::Mat c_mask(mask.rows(), mask.cols(), CV_8UC1);
-    cv::eigen2cv(mask, c_mask);
-    tmp = tmp(cv::Range(borderSize, tmp.rows-borderSize),
-              cv::Range(borderSize, tmp.cols-borderSize));
-    c_mask = c_mask(cv::Range(borderSize, c_mask.rows-borderSize),
-                    cv::Range(borderSize, c_mask.cols-borderSize));
-    cv::bitwise_and(tmp, c_mask, tmp);
-
-    /* Convert to CV_8U and then remove small blobs */
+    /* Convert to CV_8U, to match the mask, then apply it and remove
+       small blobs */
     cv::Mat toClean;
     tmp.convertTo(toClean, CV_8U);
+    cv::bitwise_and(toClean, c_mask, toClean);
     removeSmallBlobs(toClean, 20);
 
     /* Perform morphological close */
@@ -390,7 +394,7 @@ splitSampleSet(const sampleSet &samples,
     std::random_shuffle(idxs.begin(), idxs.end());
 
     for (unsigned int i = 0; i < subsetSamplesNo; ++i) {
-        samples_tree[i] = samples[idxs[i]];
+        samples_tree.set(i, samples[idxs[i]]);
         Y_tree(i) = Y[idxs[i]];
         W_tree(i) = W[idxs[i]];
     }
@@ -403,17 +407,17 @@ splitSampleSet(const sampleSet &samples,
     float sumPosW = 0;
     float sumNegW = 0;
     for (unsigned int i = subsetSamplesNo; i < samples.size(); ++i) {
-        if (samples[idxs[i]].label == POS_GT_CLASS) {
+        if (samples.label(idxs[i]) == POS_GT_CLASS) {
             posIdxs.push_back(idxs[i]);
             posW.push_back(W(idxs[i]));
             sumPosW += W(idxs[i]);
-        } else if (samples[idxs[i]].label == NEG_GT_CLASS) {
+        } else if (samples.label(idxs[i]) == NEG_GT_CLASS) {
             negIdxs.push_back(idxs[i]);
             negW.push_back(W(idxs[i]));
             sumNegW += W(idxs[i]);
         } else {
             log_err("Unrecognized label %d (sample %d)",
-                    samples[idxs[i]].label, idxs[i]);
+                    samples.label(idxs[i]), idxs[i]);
             return -EXIT_FAILURE;
         }
     }
@@ -433,14 +437,14 @@ splitSampleSet(const sampleSet &samples,
     float posWeightsMul = 0;
     float negWeightsMul = 0;
     for (unsigned int i = 0; i < posNo; ++i) {
-        samples_fl[i] = samples[posIdxs[idxPosIdxs[i]]];
+        samples_fl.set(i, samples[posIdxs[idxPosIdxs[i]]]);
         W_fl(i) = W(posIdxs[idxPosIdxs[i]]);
         posWeightsMul += W_fl(i);
         Y_fl(i) = Y(posIdxs[idxPosIdxs[i]]);
     }
 
     for (unsigned int i = 0; i < negNo; ++i) {
-        samples_fl[i+posNo] = samples[negIdxs[idxNegIdxs[i]]];
+        samples_fl.set(i+posNo, samples[negIdxs[idxNegIdxs[i]]]);
         W_fl(i+posNo) = W(negIdxs[idxNegIdxs[i]]);
         negWeightsMul += W_fl(i+posNo);
         Y_fl(i+posNo) = Y(negIdxs[idxNegIdxs[i]]);
@@ -456,6 +460,18 @@ splitSampleSet(const sampleSet &samples,
     return EXIT_SUCCESS;
 }
 
+void
+permuteVector(const std::vector< unsigned int > &order, EVec &V)
+{
+    assert ((size_t)V.size() == order.size());
+
+    EVec permuted(V.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        permuted(i) = V(order[i]);
+    }
+    V.swap(permuted);
+}
+
 #ifdef MOVABLE_TRAIN
 int
 createDirectories(Parameters &params, const Dataset &dataset)
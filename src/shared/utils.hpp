@@ -77,13 +77,12 @@ float computeF1Score(const cv::Mat &scoreImage,
  * computeMR() - Given an image and the corresponding ground-truth, compute the
  *               misclassification rate
  *
- * @img       : image to evaluate
- * @gt        : corresponding ground-truth
- * @borderSize: size of the border to ignore
+ * @img: image to evaluate
+ * @gt : corresponding ground-truth
  *
  * Return: misclassification rate in [0, 1]
  */
-float computeMR(const EMat &img, const EMat &gt, const unsigned int borderSize);
+float computeMR(const EMat &img, const ELabelMat &gt);
 
 /**
  * cvMatEquals() - Compare two OpenCV matrices for equality
@@ -100,11 +99,9 @@ bool cvMatEquals(const cv::Mat m1, const cv::Mat m2);
  *                    OpenCV format
  *
  * @resultImage: image obtained from the classification algorithm
- * @bordersize : size of the border to drop
  * @scoreImage : output image, normalized in [-1, 1]
  */
 void normalizeImage(const EMat &resultImage,
-                    const int borderSize,
                     cv::Mat &scoreImage);
 
 /**
@@ -156,6 +153,32 @@ randomWeightedSamplingWithReplacement(const unsigned int M,
     return randomSamples;
 }
 
+/**
+ * reflectIndex() - Map an index falling outside [0, n-1] to the
+ *                  corresponding index in the reflected image (that is,
+ *                  following OpenCV's BORDER_REFLECT convention: fedcba|abcdef)
+ *
+ * @idx: index to map
+ * @n  : size of the considered dimension
+ *
+ * Return: index in [0, n-1]
+ */
+static inline int
+reflectIndex(int idx, const int n)
+{
+    if (n == 1) {
+        return 0;
+    }
+    while (idx < 0 || idx >= n) {
+        if (idx < 0) {
+            idx = -idx-1;
+        } else {
+            idx = 2*n-idx-1;
+        }
+    }
+    return idx;
+}
+
 /**
  * removeSmallBlobs() - Equivalent of Matlab's bwareaopen(), taken from
  *                      http://opencv-code.com/quick-tips/code-replacement-for-matlabs-bwareaopen/
@@ -174,12 +197,24 @@ void removeSmallBlobs(cv::Mat& img, float size);
  * @dirPath    : path of the destination directory
  * @imgName    : name of the destination image (it is the same as the original
  *               image name)
- * @borderSize : size of the border to drop
+ * @mask       : optional mask of the classified pixels, the other ones being
+ *               saved as 0 (an empty mask includes all the pixels)
  */
 void saveClassifiedImage(const EMat &classResult,
                          const std::string &dirPath,
                          const std::string &imgName,
-                         const unsigned int borderSize);
+                         const EByteMat *mask = nullptr);
+
+/**
+ * saveClassifiedImage() - Save the result of a classification held in an
+ *                         OpenCV matrix (CV_32FC1) as an image on disk
+ *
+ * See the Eigen version above for the arguments.
+ */
+void saveClassifiedImage(const cv::Mat &classResult,
+                         const std::string &dirPath,
+                         const std::string &imgName,
+                         const EByteMat *mask = nullptr);
 
 /**
  * saveThresholdedImage() - Save the thresholded result to disk
@@ -191,16 +226,14 @@ void saveClassifiedImage(const EMat &classResult,
  * @imgName     : name of the destination image (it is the same as the original
  *                image name)
  * @originalSize: original image dimensions
- * @borderSize  : size of the border to drop
  */
 void
 saveThresholdedImage(const cv::Mat &classResult,
-                     const EMat &mask,
+                     const EByteMat &mask,
                      const float threshold,
                      const std::string &dirPath,
                      const std::string &imgName,
-                     const std::pair< int, int >& originalSize,
-                     const unsigned int borderSize);
+                     const std::pair< int, int >& originalSize);
 
 /**
  * saveOverlayedImage() - Save the thresholded result, overlayed to the input
@@ -246,6 +279,14 @@ int splitSampleSet(const sampleSet &samples,
                    EVec &W_fl,
                    EVec &W_tree);
 
+/**
+ * permuteVector() - Reorder a vector according to a permutation
+ *
+ * @order: permutation: the i-th output element is the order[i]-th input one
+ * @V    : vector to reorder in place
+ */
+void permuteVector(const std::vector< unsigned int > &order, EVec &V);
+
 #ifdef MOVABLE_TRAIN
 /**
  * createDirectories() - Create the set of directories needed by the simulation
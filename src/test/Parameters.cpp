@@ -129,6 +129,15 @@ Parameters::Parameters(int argc, char **argv)
                            + maskPathsFName).c_str());
 
         GET_FLOAT_PARAM(threshold);
+        GET_STRING_PARAM(channelCacheDir);
+        GET_INT_PARAM(maxResidentImages);
+        GET_INT_PARAM(readerThreadsNo);
+        GET_INT_PARAM(readerQueueDepth);
+        GET_INT_PARAM(tileSize);
+        GET_INT_PARAM(imagesInFlight);
+        GET_INT_PARAM(concurrentImagesNo);
+        GET_INT_PARAM(responsePlanesMB);
+        GET_INT_PARAM(threadsNo);
 
         /*
          * Loading sample size, channel list, and the other inherited parameters
@@ -172,6 +181,8 @@ Parameters::Parameters(int argc, char **argv)
             KB_root["KernelBoost"].get("RBCdetection", false).asBool();
         useAutoContext =
             KB_root["KernelBoost"]["useAutoContext"].asBool();
+        compactChannels =
+            KB_root["KernelBoost"].get("compactChannels", false).asBool();
 
         for (Json::Value::iterator it =
                  KB_root["KernelBoost"]["Channels"].begin();
@@ -66,6 +66,33 @@ const std::string defaultConfigFName = "test_config.json";
  * @useAutoContext  : enable the use of AutoContext
  * @baseResDir	    : base directory path for output results
  * @channelList	    : list of channels requested by user
+ * @compactChannels : store the channels as 8-bit codes or half-precision
+ *                    values instead of float ones (read from the classifier)
+ * @channelCacheDir : directory where the data computed from each image is
+ *                    cached across runs (empty to disable the cache)
+ * @maxResidentImages: maximum number of images whose channels are kept in
+ *                    memory, the other ones are mapped back from the cache
+ *                    when needed (0 to keep all the images in memory)
+ * @readerThreadsNo : number of threads decoding the input images ahead of
+ *                    the channels computation (on top of threadsNo)
+ * @readerQueueDepth: maximum number of input images decoded ahead of their
+ *                    use
+ * @tileSize        : side of the tiles on which the images are classified,
+ *                    bounding the memory used by the channels (0 to
+ *                    classify each image as a whole)
+ * @imagesInFlight  : number of images loaded, classified and saved at the
+ *                    same time, one after the other, instead of loading
+ *                    all of them upfront (0 to load all of them upfront)
+ * @concurrentImagesNo: maximum number of images loaded upfront that are
+ *                    classified at the same time, the threads left being
+ *                    shared by the filters and trees of each image (0 for
+ *                    as many as the threads allow)
+ * @responsePlanesMB: memory bound, in MB, of the filter responses of all the
+ *                    images classified at the same time, split evenly among
+ *                    them (1024 in the default configuration)
+ * @threadsNo       : number of threads shared by all the parallel loops,
+ *                    OpenCV and Eigen included (0 to use all the hardware
+ *                    threads)
  * @configFName	    : path of the configuration file
  */
 class Parameters {
@@ -94,6 +121,16 @@ public:
 
 	std::string baseResDir;
 	std::vector< std::string > channelList;
+	bool compactChannels;
+	std::string channelCacheDir;
+	unsigned int maxResidentImages;
+	unsigned int readerThreadsNo;
+	unsigned int readerQueueDepth;
+	unsigned int tileSize;
+	unsigned int imagesInFlight;
+	unsigned int concurrentImagesNo;
+	unsigned int responsePlanesMB;
+	unsigned int threadsNo;
 
 	/**
 	 * Parameters() - Empty constructor for testing
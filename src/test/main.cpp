@@ -24,6 +24,7 @@
 #include "Dataset.hpp"
 #include "KernelBoost.hpp"
 #include "logging.hpp"
+#include "scheduler.hpp"
 #include "utils.hpp"
 
 int
@@ -35,6 +36,7 @@ main(int argc, char **argv)
         /* Requested 'help' in command line args */
         return EXIT_SUCCESS;
     }
+    initScheduler(params.threadsNo);
 
     log_info("Loading dataset...");
     Dataset dataset(params);
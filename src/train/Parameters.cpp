@@ -156,6 +156,8 @@ Parameters::Parameters(int argc, char **argv)
         GET_INT_PARAM(minFilterSize);
         GET_INT_PARAM(maxFilterSize);
         GET_INT_PARAM(nRotations);
+        GET_BOOL_PARAM(virtualAugmentation);
+        GET_BOOL_PARAM(flipAugmentation);
 
         GET_FLOAT_PARAM(houghMinDist);
         GET_FLOAT_PARAM(houghHThresh);
@@ -166,8 +168,15 @@ Parameters::Parameters(int argc, char **argv)
         GET_INT_PARAM(wlNo);
         GET_INT_PARAM(treeDepth);
         GET_INT_PARAM(finalTreeDepth);
+        GET_FLOAT_PARAM(separableMaxError);
 
         GET_STRING_ARRAY(channelList);
+        GET_BOOL_PARAM(compactChannels);
+        GET_STRING_PARAM(channelCacheDir);
+        GET_INT_PARAM(maxResidentImages);
+        GET_INT_PARAM(readerThreadsNo);
+        GET_INT_PARAM(readerQueueDepth);
+        GET_INT_PARAM(threadsNo);
 
         if (!useAutoContext && gtValues.size() > 2) {
             log_err("More than two ground-truth values have been specified, "
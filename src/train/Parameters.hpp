@@ -74,6 +74,10 @@ const std::string defaultConfigFName = "train_config.json";
  * @maxFilterSize   : maximum filter size
  * @nRotations      : number of rotated versions of the training samples that
  *                    have to be considered
+ * @virtualAugmentation: generate the rotated samples on the fly from the
+ *                    plain images instead of storing rotated images
+ * @flipAugmentation: with virtual augmentation, also consider the mirrored
+ *                    version of each rotated sample
  * @houghMinDist    : minimum distance between RBCs for the Hough method
  * @houghHThresh    : higher threshold on Canny's output in the Hough method
  * @houghLThresh    : lower threshold on Canny's output in the Hough method
@@ -82,6 +86,9 @@ const std::string defaultConfigFName = "train_config.json";
  * @wlNo            : number of weak-learners to learn
  * @treeDepth       : maximum depth of the regression trees
  * @finalTreeDepth  : depth of the final tree
+ * @separableMaxError: maximum relative error of the approximation of each
+ *                    learned filter as a sum of separable terms (0 to keep
+ *                    the filters dense)
  * @smoothingValues : list of smoothing values
  * @fastClassifier  : enable fast classification (only candidate points are
  *                    tested)
@@ -92,6 +99,21 @@ const std::string defaultConfigFName = "train_config.json";
  *                    stored
  * @finalResDir     : directory where final results will be stored
  * @channelList     : list of channels requested by user
+ * @compactChannels : store the channels as 8-bit codes or half-precision
+ *                    values instead of float ones (reduces the memory
+ *                    footprint of the dataset)
+ * @channelCacheDir : directory where the data computed from each image is
+ *                    cached across runs (empty to disable the cache)
+ * @maxResidentImages: maximum number of images whose channels are kept in
+ *                    memory, the other ones are mapped back from the cache
+ *                    when needed (0 to keep all the images in memory)
+ * @readerThreadsNo : number of threads decoding the input images ahead of
+ *                    the channels computation (on top of threadsNo)
+ * @readerQueueDepth: maximum number of input images decoded ahead of their
+ *                    use
+ * @threadsNo       : number of threads shared by all the parallel loops,
+ *                    OpenCV and Eigen included (0 to use all the hardware
+ *                    threads)
  * @configFName     : path of the configuration file
  * @configBkpPath   : path of the copy of the configuration file that is put in
  *                    the results directory
@@ -127,6 +149,8 @@ public:
     unsigned int minFilterSize;
     unsigned int maxFilterSize;
     unsigned int nRotations;
+    bool virtualAugmentation;
+    bool flipAugmentation;
 
     double houghMinDist;
     double houghHThresh;
@@ -141,8 +165,15 @@ public:
     unsigned int wlNo;
     unsigned int treeDepth;
     unsigned int finalTreeDepth;
+    float separableMaxError;
 
     std::vector< std::string > channelList;
+    bool compactChannels;
+    std::string channelCacheDir;
+    unsigned int maxResidentImages;
+    unsigned int readerThreadsNo;
+    unsigned int readerQueueDepth;
+    unsigned int threadsNo;
 
     /* Computed values */
     std::vector< float > smoothingValues;
@@ -24,6 +24,7 @@
 
 #include "DataTypes.hpp"
 #include "SmoothingMatrices.hpp"
+#include "scheduler.hpp"
 
 /**
  * TRY() - Explore neighboring pixel in the given direction
@@ -69,8 +70,7 @@ SmoothingMatrices::SmoothingMatrices(const unsigned int minSize,
 
 	/* Valgrind will complain a lot about this -- but this is a problem in
 	   the way Valgrind detects issues, not a real leak */
-#pragma omp parallel for schedule(dynamic)
-	for (unsigned int iS = 0; iS < nSize; ++iS) {
+	parallelFor(nSize, [&](unsigned int iS) {
 		M[iS].resize(smoothingValues.size());
 
 		EMat smOnes = createSmoothingMatrixOnes(sizes[iS]);
@@ -78,7 +78,7 @@ SmoothingMatrices::SmoothingMatrices(const unsigned int minSize,
 			assert (smoothingValues[iL] > 0);
 			M[iS][iL] = smOnes*sqrt(smoothingValues[iL]);
 		}
-	}
+	});
 }
 
 EMat
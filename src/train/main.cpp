@@ -25,6 +25,7 @@
 #include "SmoothingMatrices.hpp"
 #include "KernelBoost.hpp"
 #include "logging.hpp"
+#include "scheduler.hpp"
 #include "utils.hpp"
 
 int
@@ -43,6 +44,7 @@ main(int argc, char **argv)
         /* Requested 'help' in command line args */
         return EXIT_SUCCESS;
     }
+    initScheduler(params.threadsNo);
 
     log_info("Loading dataset...");
     Dataset dataset(params);